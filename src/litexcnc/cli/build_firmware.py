@@ -52,5 +52,11 @@ def cli(config, output_directory, build):
     )
     builder.build(run=build)
 
+    # Write the layout of the registers, which can be used to inspect the data exchanged
+    # with the board. The driver checks the hash of the layout when it is loaded.
+    print("Generated layout hash: ", soc.MMIO_inst.layout_hash)
+    with open(os.path.join(output_directory, "litexcnc_layout.h"), 'w') as layout_header:
+        layout_header.write(soc.MMIO_inst.layout_header(firmware_config.board_name))
+
     # Done!
     click.echo(click.style("INFO", fg="blue") + f": Firmware created in {output_directory}")
\ No newline at end of file
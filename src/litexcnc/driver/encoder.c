@@ -162,41 +162,26 @@ uint8_t litexcnc_encoder_prepare_write(litexcnc_t *litexcnc, uint8_t **data, lon
         return 0;
     }
 
-    // Declaration of shared variables
-    uint8_t mask;
-
-    // Index enable (shared register)
-    mask = 0x80;
-    for (size_t i=LITEXCNC_BOARD_ENCODER_SHARED_INDEX_ENABLE_WRITE_SIZE(litexcnc)*8; i>0; i--) {
-        // The counter i can have a value outside the range of possible instances. We only
-        // should add data from existing instances
-        if (i < litexcnc->encoder.num_instances) {
-            *(*data) |= *(litexcnc->encoder.instances[i-1].hal.pin.index_enable)?mask:0;
-        }
-        // Modify the mask for the next. When the mask is zero (happens in case of a 
-        // roll-over), we should proceed to the next byte and reset the mask.
-        mask >>= 1;
-        if (!mask) {
-            mask = 0x80;  // Reset the mask
-            (*data)++; // Proceed the buffer to the next element
+    // Index enable (shared register), a word at a time (see `litexcnc_flag_write`)
+    for (size_t word=0; word<litexcnc_flag_words(litexcnc->encoder.num_instances); word++) {
+        litexcnc_encoder_instance_t *instances = &litexcnc->encoder.instances[litexcnc_flag_first(litexcnc->encoder.num_instances, word)];
+        size_t count = litexcnc_flag_count(litexcnc->encoder.num_instances, word);
+        uint32_t flags = 0;
+        for (size_t i=0; i<count; i++) {
+            flags |= (uint32_t) (*(instances[i].hal.pin.index_enable) != 0) << i;
         }
+        litexcnc_flag_write(data, flags);
     }
 
     // Reset index pulse (shared register)
-    mask = 0x80;
-    for (size_t i=LITEXCNC_BOARD_ENCODER_SHARED_RESET_INDEX_PULSE_WRITE_SIZE(litexcnc)*8; i>0; i--) {
-        // The counter i can have a value outside the range of possible instances. We only
-        // should add data from existing instances
-        if (i < litexcnc->encoder.num_instances) {
-            *(*data) |= *(litexcnc->encoder.instances[i-1].hal.pin.index_pulse)?mask:0;
-        }
-        // Modify the mask for the next. When the mask is zero (happens in case of a 
-        // roll-over), we should proceed to the next byte and reset the mask.
-        mask >>= 1;
-        if (!mask) {
-            mask = 0x80;  // Reset the mask
-            (*data)++; // Proceed the buffer to the next element
+    for (size_t word=0; word<litexcnc_flag_words(litexcnc->encoder.num_instances); word++) {
+        litexcnc_encoder_instance_t *instances = &litexcnc->encoder.instances[litexcnc_flag_first(litexcnc->encoder.num_instances, word)];
+        size_t count = litexcnc_flag_count(litexcnc->encoder.num_instances, word);
+        uint32_t flags = 0;
+        for (size_t i=0; i<count; i++) {
+            flags |= (uint32_t) (*(instances[i].hal.pin.index_pulse) != 0) << i;
         }
+        litexcnc_flag_write(data, flags);
     }
 
     return 0;
@@ -220,30 +205,20 @@ uint8_t litexcnc_encoder_process_read(litexcnc_t *litexcnc, uint8_t** data, long
         return 0;
     }
 
-    // Declaration of shared variables
-    uint8_t mask;
-
-    // Index pulse (shared register)
-    mask = 0x80;
-    for (size_t i=LITEXCNC_BOARD_ENCODER_SHARED_INDEX_PULSE_READ_SIZE(litexcnc)*8; i>0; i--) {
-        // The counter i can have a value outside the range of possible instances. We only
-        // should add data to existing instances
-        if (i < litexcnc->encoder.num_instances) {
-            uint8_t index_pulse = (*(*data) & mask)?1:0;
+    // Index pulse (shared register), a word at a time (see `litexcnc_flag_read`)
+    for (size_t word=0; word<litexcnc_flag_words(litexcnc->encoder.num_instances); word++) {
+        litexcnc_encoder_instance_t *instances = &litexcnc->encoder.instances[litexcnc_flag_first(litexcnc->encoder.num_instances, word)];
+        size_t count = litexcnc_flag_count(litexcnc->encoder.num_instances, word);
+        uint32_t flags = litexcnc_flag_read(data);
+        for (size_t i=0; i<count; i++) {
+            hal_bit_t index_pulse = (flags >> i) & 1;
             // Reset the index enable on positive edge of the index pulse
             // NOTE: the FPGA only sets the index pulse when a raising flank has been detected
             if (index_pulse) {
-                *(litexcnc->encoder.instances[i-1].hal.pin.index_enable) = 0;
+                *(instances[i].hal.pin.index_enable) = 0;
             }
             // Set the index pulse
-            *(litexcnc->encoder.instances[i-1].hal.pin.index_pulse) = index_pulse;
-        }
-        // Modify the mask for the next. When the mask is zero (happens in case of a 
-        // roll-over), we should proceed to the next byte and reset the mask.
-        mask >>= 1;
-        if (!mask) {
-            mask = 0x80;  // Reset the mask
-            (*data)++; // Proceed the buffer to the next element
+            *(instances[i].hal.pin.index_pulse) = index_pulse;
         }
     }
     
@@ -339,4 +314,26 @@ uint8_t litexcnc_encoder_process_read(litexcnc_t *litexcnc, uint8_t** data, long
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+
+static size_t litexcnc_encoder_write_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_BOARD_ENCODER_DATA_WRITE_SIZE(litexcnc);
+}
+
+
+static size_t litexcnc_encoder_read_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_BOARD_ENCODER_DATA_READ_SIZE(litexcnc);
+}
+
+
+// Description of the module for the LitexCNC driver (see `litexcnc_module_t`)
+const litexcnc_module_t litexcnc_encoder_module = {
+    .name = "Encoder",
+    .init = litexcnc_encoder_init,
+    .prepare_write = litexcnc_encoder_prepare_write,
+    .write_size = litexcnc_encoder_write_size,
+    .write_slow = true,
+    .process_read = litexcnc_encoder_process_read,
+    .read_size = litexcnc_encoder_read_size,
+};
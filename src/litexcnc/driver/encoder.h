@@ -149,5 +149,6 @@ int litexcnc_encoder_init(litexcnc_t *litexcnc, cJSON *config);
 uint8_t litexcnc_encoder_config(litexcnc_t *litexcnc, uint8_t **data, long period);
 uint8_t litexcnc_encoder_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period);
 uint8_t litexcnc_encoder_process_read(litexcnc_t *litexcnc, uint8_t** data, long period);
+extern const litexcnc_module_t litexcnc_encoder_module;
 
 #endif
\ No newline at end of file
@@ -1,3 +1,7 @@
+// Required for sendmmsg and recvmmsg
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #if defined(__FreeBSD__)
 #include <sys/endian.h>
 #else
@@ -14,9 +18,14 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h> 
+#include <time.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <linux/net_tstamp.h>
 
 #include "etherbone.h"
+#include "etherbone_raw.h"
+#include "etherbone_xdp.h"
 #include "litexcnc.h"
 
 //#define TIME_ETHERBONE
@@ -33,218 +42,515 @@ struct eb_connection {
     int read_fd;
     int is_direct;
     struct addrinfo* addr;
+    // Raw transport (AF_PACKET), NULL when the sockets of the kernel are used
+    struct eb_raw *raw;
+    // AF_XDP transport, NULL when not used
+    struct eb_xdp *xdp;
+    // Spacing of the transmitted packets
+    uint64_t tx_gap_ns;         // Minimum time between two packets
+    uint64_t tx_last_launch;    // Launch time of the last packet (CLOCK_MONOTONIC)
+    int txtime_available;       // SO_TXTIME could be set on the socket
+    int use_txtime;             // Use the launch time of the kernel (requires an ETF qdisc)
+    // Receiving of the packets
+    uint64_t rx_deadline;       // Time at which a receive gives up (CLOCK_MONOTONIC), 0 for the default timeout
+    int busy_poll;              // Spin on the socket instead of sleeping until a packet arrives
 };
 
 
-unsigned long timestampUsec()  // this can roll over! for debug only
-{
-	struct timeval timestamp;
-	
-	gettimeofday(&timestamp, NULL);
-	
-	return(timestamp.tv_sec * 1000000 + ( timestamp.tv_usec));
+static inline uint64_t timespec_to_ns(const struct timespec *ts) {
+    return (uint64_t) ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+
+static inline uint64_t clock_ns(clockid_t clock) {
+    // NOTE: clock_gettime is handled by the vDSO, it does not require a system call
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return timespec_to_ns(&ts);
 }
 
+
 // sleep for some microseconds.
 // this method will allow for rescheduling
 void usecSleep(long usec) {
-    long ts1=timestampUsec();
-	
-	struct timeval tv;
-	tv.tv_sec = 0;
-	tv.tv_usec = usec;
-	select(0, NULL, NULL, NULL, &tv);
-	
-    long ts2=timestampUsec();
-    long dura = ts2 - ts1; // can roll...
-    if ( dura > 0 && dura > usec + 100) {
-	    fprintf(stderr, "colorcnc debug: overslept %ld instad of %ld usec\n", dura, usec);
+    struct timespec ts;
+    ts.tv_sec = usec / 1000000;
+    ts.tv_nsec = (usec % 1000000) * 1000;
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+}
+
+
+void eb_set_tx_gap(struct eb_connection *conn, uint32_t gap_ns, int use_txtime) {
+    conn->tx_gap_ns = gap_ns;
+    use_txtime = use_txtime && conn->txtime_available;
+    if (use_txtime == conn->use_txtime)
+        return;
+    // The ETF qdisc drops the packets without a launch time. Therefore the packets are
+    // only put in the traffic class of the ETF qdisc (see EB_TXTIME_PRIORITY) while
+    // each packet gets a launch time, so the other packets (e.g. when the board is
+    // initialised) are sent through the default traffic class.
+    int priority = use_txtime ? EB_TXTIME_PRIORITY : 0;
+    if (setsockopt(conn->fd, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)) < 0) {
+        fprintf(stderr, "etherbone: unable to set the priority of the socket: %s\n", strerror(errno));
+        // Don't try to use the launch time again
+        if (use_txtime)
+            conn->txtime_available = 0;
+        return;
     }
+    conn->use_txtime = use_txtime;
 }
 
 
-void eb_wait_for_tx_buffer_empty(struct eb_connection *conn) {
-    int tx_queue_len = 0, first = 1;
-    int tx_queue_max_len = 0;
-    int peekCount = 0;
-    // long time1 = timestampUsec();
-    
-    while ( first || tx_queue_len > 0) {
-	    if (tx_queue_len > 0) {
-            usecSleep(10);
-            // fprintf(stderr, "Queue length: %d \n", tx_queue_len);
+static void eb_schedule_tx(struct eb_connection *conn, struct msghdr *msg, uint8_t *control, size_t control_size) {
+    /*
+     * Spaces the packets with at least the minimum gap, because the colorlight card
+     * crashes when two packets come close to each other. The launch time is the
+     * earliest time the gap allows. When the launch time of the kernel is used, the
+     * launch time is given to the ETF qdisc, which sends the packet at that time.
+     * Otherwise the thread sleeps until the launch time. In both cases there is no
+     * polling of the socket.
+     */
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    uint64_t launch = conn->tx_last_launch + conn->tx_gap_ns;
+
+#ifdef SO_TXTIME
+    if (conn->use_txtime && msg) {
+        // The ETF qdisc drops packets with a launch time in the past, so some margin
+        // is required for passing the packet to the kernel.
+        if (launch < now + EB_TXTIME_MARGIN_NS) {
+            launch = now + EB_TXTIME_MARGIN_NS;
         }
-	    int rc = ioctl(conn->fd, TIOCOUTQ, &tx_queue_len);
-	    if ( rc < 0) {
-		    perror("colorcnc: cannot ioctl?");
-		    exit(1);
-	    }
-	    if ( tx_queue_len > tx_queue_max_len ) tx_queue_max_len = tx_queue_len;
-	    first = 0;
-	    ++peekCount;
+        // The ETF qdisc uses CLOCK_TAI as reference
+        uint64_t txtime = launch + (clock_ns(CLOCK_TAI) - clock_ns(CLOCK_MONOTONIC));
+        msg->msg_control = control;
+        msg->msg_controllen = control_size;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_TXTIME;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(txtime));
+        memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+        conn->tx_last_launch = launch;
+        return;
+    }
+#endif
+
+    if (launch > now) {
+        struct timespec ts;
+        ts.tv_sec = launch / 1000000000ULL;
+        ts.tv_nsec = launch % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+    } else {
+        launch = now;
     }
-    
-    // long time2 = timestampUsec();
-    // long dura = time2 - time1;
-    // if (dura > 300) {
-	//     fprintf(stderr, "colorcnc debug: waited for socket tx_queue to clear for %ld usec, %d samples, max len %d\n", dura, peekCount, tx_queue_max_len);
-    // }
-    
+    conn->tx_last_launch = launch;
 }
 
 
 int eb_send(struct eb_connection *conn, const void *bytes, size_t len) {
-    if (conn->is_direct)
-        return sendto(conn->fd, bytes, len, 0, conn->addr->ai_addr, conn->addr->ai_addrlen);
-    return write(conn->fd, bytes, len);
+    struct iovec iov = {.iov_base = (void *) bytes, .iov_len = len};
+    return eb_sendv(conn, &iov, 1);
 }
 
 
-int eb_recv(struct eb_connection *conn, void *bytes, size_t max_len) {
-    if (conn->is_direct)
-        return recvfrom(conn->read_fd, bytes, max_len, 0, NULL, NULL);
-    return read(conn->fd, bytes, max_len);
+int eb_sendv(struct eb_connection *conn, const struct iovec *iov, int iovcnt) {
+    // Sends a packet which is scattered over multiple buffers, without copying the
+    // buffers into a single packet first.
+    if (conn->raw) {
+        eb_schedule_tx(conn, NULL, NULL, 0);
+        return eb_raw_sendv(conn->raw, iov, iovcnt);
+    }
+    if (conn->xdp) {
+        eb_schedule_tx(conn, NULL, NULL, 0);
+        return eb_xdp_sendv(conn->xdp, iov, iovcnt);
+    }
+    if (conn->is_direct) {
+        uint8_t control[CMSG_SPACE(sizeof(uint64_t))] __attribute__((aligned(8)));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name    = conn->addr->ai_addr;
+        msg.msg_namelen = conn->addr->ai_addrlen;
+        msg.msg_iov     = (struct iovec *) iov;
+        msg.msg_iovlen  = iovcnt;
+        eb_schedule_tx(conn, &msg, control, sizeof(control));
+        return sendmsg(conn->fd, &msg, 0);
+    }
+    eb_schedule_tx(conn, NULL, NULL, 0);
+    return writev(conn->fd, iov, iovcnt);
 }
 
 
-int eb_read8(struct eb_connection *conn, uint32_t address, uint8_t* data, size_t size, bool debug) {
-    // Create a buffer for the header (16 bytes) + maximum payload size (255). The header of the etherbone
-    // package consist of the following fields:
-    // 0x00 = 0x4e;	     // Magic byte 0
-    // 0x01 = 0x6f;	     // Magic byte 1
-    // 0x02 = 0x10;	     // Version 1, all other flags 0
-    // 0x03 = 0x44;   	 // Address is 32-bits, port is 32-bits
-    // 0x04 = 0;		 // Padding
-    // 0x05 = 0;		 // Padding
-    // 0x06 = 0;	 	 // Padding
-    // 0x07 = 0;	 	 // Padding
-    // 0x08 = 0;		 // No Wishbone flags are set (cyc, wca, wff, etc.)
-    // 0x09 = 0x0f;	     // Byte enable
-    static uint8_t eth_pkt[16+255] = { 0x4e, 0x6f, 0x10, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f };
-    static uint8_t response[16+255];
-
-     // Clear data and write data to package
-    memset((void*) &eth_pkt[16], 0, 255);
-    // - size
-    size_t words = size >> 2;
-    eth_pkt[11] = words; // Write count (in WORD-count, bitshift to divide by 4)
-    // - addresses to read
-    uint32_t addresses[words];
-    for (size_t i=0; i<words; i++) {
-        addresses[i] = htobe32(address + (i << 2));
+static int eb_sendmmsg(int fd, struct mmsghdr *msgs, int n) {
+    // Passes all messages to the kernel, sendmmsg might send only a part of them. Returns
+    // the number of messages sent, which is less than n when an error occurred.
+    int sent = 0;
+    while (sent < n) {
+        int r = sendmmsg(fd, &msgs[sent], n - sent, 0);
+        if (r <= 0)
+            break;
+        sent += r;
     }
-    memcpy(&eth_pkt[16], addresses, size);
+    return sent;
+}
 
-    if (debug) {
-        LITEXCNC_PRINT_NO_DEVICE("Read addresses:\n");
-        for (size_t i=0; i<(16+size); i+=4) {
-            LITEXCNC_PRINT_NO_DEVICE("%02X %02X %02X %02X\n",
-                (unsigned char)eth_pkt[i+0],
-                (unsigned char)eth_pkt[i+1],
-                (unsigned char)eth_pkt[i+2],
-                (unsigned char)eth_pkt[i+3]);
+
+static int eb_flush_batch(int fd, struct mmsghdr *msgs, const int *index, int n, int *failed) {
+    // Sends the batched messages and marks the connections of the messages which could not
+    // be sent as failed
+    int sent = eb_sendmmsg(fd, msgs, n);
+    for (int i=sent; i<n; i++)
+        failed[index[i]] = 1;
+    return sent < n ? -1 : 0;
+}
+
+
+int eb_send_batch(struct eb_connection **conns, struct iovec *const *iovs, const int *iovcnts, int count, int *failed) {
+    /*
+     * Sends a packet to each of the connections. The packets sent with UDP are passed to
+     * the kernel in a single system call (sendmmsg), using the socket of the first UDP
+     * connection. The packets of the other transports are sent one by one. Returns 0 on
+     * success or a negative value when one of the packets could not be sent, in which
+     * case `failed` is set for the connections of which the packet was not sent.
+     *
+     * The traffic class of the packets is set by the socket (see `eb_set_tx_gap`), so
+     * the packets with a launch time are not sent together with the packets without.
+     */
+    struct mmsghdr msgs[EB_MAX_BATCH];
+    int index[EB_MAX_BATCH];
+    uint8_t control[EB_MAX_BATCH][CMSG_SPACE(sizeof(uint64_t))] __attribute__((aligned(8)));
+    int fd = -1;
+    int use_txtime = 0;
+    int n = 0;
+    int result = 0;
+
+    for (int i=0; i<count; i++) {
+        struct eb_connection *conn = conns[i];
+        failed[i] = 0;
+        if (conn->raw || conn->xdp || !conn->is_direct) {
+            if (eb_sendv(conn, iovs[i], iovcnts[i]) < 0) {
+                failed[i] = 1;
+                result = -1;
+            }
+            continue;
+        }
+        if (n && conn->use_txtime != use_txtime) {
+            if (eb_flush_batch(fd, msgs, index, n, failed) < 0)
+                result = -1;
+            n = 0;
+        }
+        memset(&msgs[n], 0, sizeof(msgs[n]));
+        msgs[n].msg_hdr.msg_name    = conn->addr->ai_addr;
+        msgs[n].msg_hdr.msg_namelen = conn->addr->ai_addrlen;
+        msgs[n].msg_hdr.msg_iov     = iovs[i];
+        msgs[n].msg_hdr.msg_iovlen  = iovcnts[i];
+        eb_schedule_tx(conn, &msgs[n].msg_hdr, control[n], sizeof(control[n]));
+        index[n] = i;
+        if (n == 0) {
+            fd = conn->fd;
+            use_txtime = conn->use_txtime;
+        }
+        if (++n == EB_MAX_BATCH) {
+            if (eb_flush_batch(fd, msgs, index, n, failed) < 0)
+                result = -1;
+            n = 0;
         }
     }
+    if (n && (eb_flush_batch(fd, msgs, index, n, failed) < 0))
+        result = -1;
+    return result;
+}
 
-    // Send the data to the device
-    eb_send(conn, eth_pkt, 16+size);
 
-    // Check response
-    memset((void*) response, 0, 16+255);
-    int count = eb_recv(conn, response, 16+size);
-    if (count != (16+size)) {
-        fprintf(stderr, "Unexpected read length: %d, expected %zu\n", count, (16+size));
-        return -1;
-    }
+int eb_get_fd(struct eb_connection *conn) {
+    // Returns the file descriptor which becomes readable when a packet is received, so
+    // multiple connections can be waited for with a single poll.
+    if (conn->raw)
+        return eb_raw_get_fd(conn->raw);
+    if (conn->xdp)
+        return eb_xdp_get_fd(conn->xdp);
+    if (conn->is_direct)
+        return conn->read_fd;
+    return conn->fd;
+}
 
-    // Unpack results
-    memcpy(data, &response[16], size);
 
-    if (debug) {
-        LITEXCNC_PRINT_NO_DEVICE("Read:\n");
-        for (size_t i=0; i<(size); i+=4) {
-            LITEXCNC_PRINT_NO_DEVICE("%02X %02X %02X %02X\n",
-                (unsigned char)data[i+0],
-                (unsigned char)data[i+1],
-                (unsigned char)data[i+2],
-                (unsigned char)data[i+3]);
+void eb_set_rx_deadline(struct eb_connection *conn, uint64_t deadline_ns) {
+    conn->rx_deadline = deadline_ns;
+}
+
+
+void eb_set_busy_poll(struct eb_connection *conn, int busy_poll) {
+    if (conn->busy_poll == !!busy_poll)
+        return;
+    conn->busy_poll = !!busy_poll;
+#ifdef SO_BUSY_POLL
+    // Let the kernel poll the queue of the network card when the socket is read, instead
+    // of waiting for the interrupt. Raising the time above the system default (sysctl
+    // net.core.busy_read) requires CAP_NET_ADMIN; without it the spinning in user space
+    // still avoids the wake-up latency, so the error is ignored.
+    int usec = conn->busy_poll ? EB_BUSY_POLL_US : 0;
+    setsockopt(eb_get_fd(conn), SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+#endif
+}
+
+
+static uint64_t eb_rx_deadline(struct eb_connection *conn) {
+    if (conn->rx_deadline)
+        return conn->rx_deadline;
+    return clock_ns(CLOCK_MONOTONIC) + EB_RECV_TIMEOUT_NS;
+}
+
+
+static int eb_wait_rx(struct eb_connection *conn, uint64_t deadline) {
+    /*
+     * Waits until a packet might have arrived or the deadline has passed. Returns 0 when
+     * the deadline has passed. In busy-poll mode the thread does not sleep, the caller
+     * tries to receive again directly.
+     */
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    if (now >= deadline)
+        return 0;
+    if (conn->busy_poll)
+        return 1;
+    struct pollfd pfd = {.fd = eb_get_fd(conn), .events = POLLIN};
+    struct timespec timeout = {
+        .tv_sec = (deadline - now) / 1000000000ULL,
+        .tv_nsec = (deadline - now) % 1000000000ULL
+    };
+    int r = ppoll(&pfd, 1, &timeout, NULL);
+    if (r < 0 && errno == EINTR)
+        return 1;
+    return r;
+}
+
+
+static int eb_recvv_nonblocking(struct eb_connection *conn, const struct iovec *iov, int iovcnt) {
+    // Receives a packet when one is available, otherwise fails with EAGAIN
+    if (conn->raw)
+        return eb_raw_recvv(conn->raw, iov, iovcnt, 0);
+    if (conn->xdp)
+        return eb_xdp_recvv(conn->xdp, iov, iovcnt, 0);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = (struct iovec *) iov;
+    msg.msg_iovlen = iovcnt;
+    return recvmsg(conn->is_direct ? conn->read_fd : conn->fd, &msg, MSG_DONTWAIT);
+}
+
+
+int eb_recv(struct eb_connection *conn, void *bytes, size_t max_len) {
+    struct iovec iov = {.iov_base = bytes, .iov_len = max_len};
+    return eb_recvv(conn, &iov, 1);
+}
+
+
+int eb_recvv(struct eb_connection *conn, const struct iovec *iov, int iovcnt) {
+    // Receives a packet and scatters it over multiple buffers, so the header and the
+    // data of a packet can be stored separately. Gives up at the deadline of the
+    // connection (see `eb_set_rx_deadline`) with EAGAIN.
+    uint64_t deadline = eb_rx_deadline(conn);
+    while (1) {
+        int r = eb_recvv_nonblocking(conn, iov, iovcnt);
+        if (r >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return r;
+        r = eb_wait_rx(conn, deadline);
+        if (r <= 0) {
+            errno = r == 0 ? EAGAIN : errno;
+            return -1;
         }
     }
+}
 
-    // Successfull read
-    return 0;
+
+uint8_t *eb_alloc_tx_buffer(struct eb_connection *conn) {
+    // Buffers to write the packet in place are only available with AF_XDP
+    if (!conn->xdp)
+        return NULL;
+    return eb_xdp_alloc_tx(conn->xdp);
 }
 
 
-void eb_write8(struct eb_connection *conn, uint32_t address, const uint8_t* data, size_t size, bool debug) {
-    // Create a buffer for the header (16 bytes) + maximum payload size (255). The header of the etherbone
-    // package consist of the following fields:
-    // 0x00 = 0x4e;	     // Magic byte 0
-    // 0x01 = 0x6f;	     // Magic byte 1
-    // 0x02 = 0x10;	     // Version 1, all other flags 0
-    // 0x03 = 0x44;   	 // Address is 32-bits, port is 32-bits
-    // 0x04 = 0;		 // Padding
-    // 0x05 = 0;		 // Padding
-    // 0x06 = 0;	 	 // Padding
-    // 0x07 = 0;	 	 // Padding
-    // 0x08 = 0;		 // No Wishbone flags are set (cyc, wca, wff, etc.)
-    // 0x09 = 0x0f;	     // Byte enable
-    static uint8_t eth_pkt[16+255] = { 0x4e, 0x6f, 0x10, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f };
-    
-    // Clear data and write data to package
-    memset((void*) &eth_pkt[16], 0, 255);
-    // - size
-    eth_pkt[10] = size >> 2; // Write count (in WORD-count, bitshift to divide by 4)
-    // - address
-    address = htobe32(address);
-    memcpy(eth_pkt + 12, &address, 4);
-    // - data
-    memcpy(eth_pkt + 16, data, size);
+int eb_send_tx_buffer(struct eb_connection *conn, uint8_t *buffer, size_t len) {
+    eb_schedule_tx(conn, NULL, NULL, 0);
+    return eb_xdp_submit_tx(conn->xdp, buffer, len);
+}
+
 
-    if (debug) {
-        LITEXCNC_PRINT_NO_DEVICE("Write:\n");
-        for (size_t i=0; i<(16+size); i+=4) {
-            LITEXCNC_PRINT_NO_DEVICE("%02X %02X %02X %02X\n",
-                (unsigned char)eth_pkt[i+0],
-                (unsigned char)eth_pkt[i+1],
-                (unsigned char)eth_pkt[i+2],
-                (unsigned char)eth_pkt[i+3]);
+int eb_recv_in_place(struct eb_connection *conn, uint8_t **buffer) {
+    if (!conn->xdp)
+        return -1;
+    uint64_t deadline = eb_rx_deadline(conn);
+    while (1) {
+        int r = eb_xdp_recv_in_place(conn->xdp, buffer, 0);
+        if (r >= 0 || errno != EAGAIN)
+            return r;
+        r = eb_wait_rx(conn, deadline);
+        if (r <= 0) {
+            errno = r == 0 ? EAGAIN : errno;
+            return -1;
         }
     }
+}
 
-    // Send the data to the device
-    eb_send(conn, eth_pkt, 16+size);
+
+void eb_release_rx_buffer(struct eb_connection *conn, uint8_t *buffer) {
+    eb_xdp_release_rx(conn->xdp, buffer);
 }
 
-// https://stackoverflow.com/questions/38071732/how-to-check-if-udp-packet-received-in-c-linux
-void eb_discard_pending_packet(struct eb_connection *conn, size_t size)
-{
-	
-    int retval;
-    fd_set rfds;
-    // NO wait
-    struct timeval tv = {0,0};
 
-    uint8_t buffer[size];
+static void eb_print_words(const char *title, const uint8_t *data, size_t size) {
+    LITEXCNC_PRINT_NO_DEVICE("%s:\n", title);
+    for (size_t i=0; i<size; i+=4) {
+        LITEXCNC_PRINT_NO_DEVICE("%02X %02X %02X %02X\n",
+            (unsigned char)data[i+0],
+            (unsigned char)data[i+1],
+            (unsigned char)data[i+2],
+            (unsigned char)data[i+3]);
+    }
+}
 
-    if (!conn->is_direct) {
-	    return;
+
+int eb_read8(struct eb_connection *conn, uint32_t address, uint8_t* data, size_t size, bool debug) {
+    /*
+     * Reads `size` bytes starting at `address`. The header of the etherbone package
+     * consist of the following fields:
+     * 0x00 = 0x4e;      // Magic byte 0
+     * 0x01 = 0x6f;      // Magic byte 1
+     * 0x02 = 0x10;      // Version 1, all other flags 0
+     * 0x03 = 0x44;      // Address is 32-bits, port is 32-bits
+     * 0x04 = 0;         // Padding
+     * 0x05 = 0;         // Padding
+     * 0x06 = 0;         // Padding
+     * 0x07 = 0;         // Padding
+     * 0x08 = 0;         // No Wishbone flags are set (cyc, wca, wff, etc.)
+     * 0x09 = 0x0f;      // Byte enable
+     * 0x0A = 0;         // Write count
+     * 0x0B = words;     // Read count
+     * 0x0C..0x0F = 0;   // Return address
+     * 
+     * A record can read at most EB_MAX_RECORD_WORDS words, larger reads are split over
+     * multiple packets.
+     */
+    uint8_t header[16];
+    uint32_t addresses[EB_MAX_RECORD_WORDS];
+
+    for (size_t offset=0; offset<size; offset+=EB_MAX_RECORD_WORDS << 2) {
+        size_t chunk = size - offset < EB_MAX_RECORD_WORDS << 2 ? size - offset : EB_MAX_RECORD_WORDS << 2;
+        size_t words = chunk >> 2;
+
+        // Create the request
+        memcpy(header, etherbone_header, sizeof(header));
+        header[11] = words;
+        for (size_t i=0; i<words; i++) {
+            addresses[i] = htobe32(address + offset + (i << 2));
+        }
+        struct iovec request[2] = {
+            {.iov_base = header,    .iov_len = sizeof(header)},
+            {.iov_base = addresses, .iov_len = chunk}
+        };
+        if (debug) {
+            eb_print_words("Read header", header, sizeof(header));
+            eb_print_words("Read addresses", (uint8_t *) addresses, chunk);
+        }
+
+        // Send the request to the device
+        eb_sendv(conn, request, 2);
+
+        // Check response, the data is stored directly at its destination
+        struct iovec response[2] = {
+            {.iov_base = header,        .iov_len = sizeof(header)},
+            {.iov_base = data + offset, .iov_len = chunk}
+        };
+        int count = eb_recvv(conn, response, 2);
+        if (count != (16+chunk)) {
+            fprintf(stderr, "Unexpected read length: %d, expected %zu\n", count, (16+chunk));
+            return -1;
+        }
     }
 
-    FD_ZERO(&rfds);
-    FD_SET(conn->fd, &rfds);
+    if (debug) {
+        eb_print_words("Read", data, size);
+    }
+
+    // Successfull read
+    return 0;
+}
+
+
+int eb_write8(struct eb_connection *conn, uint32_t address, const uint8_t* data, size_t size, bool debug) {
+    /*
+     * Writes `size` bytes starting at `address`. The header is the same as for reading
+     * (see `eb_read8`), except for the write count (0x0A) and the address to write to
+     * (0x0C..0x0F), which auto-increments. A record can write at most 
+     * EB_MAX_RECORD_WORDS words, larger writes are split over multiple packets. Returns
+     * 0 on success or -1 when a packet could not be sent.
+     */
+    uint8_t header[16];
+
+    for (size_t offset=0; offset<size; offset+=EB_MAX_RECORD_WORDS << 2) {
+        size_t chunk = size - offset < EB_MAX_RECORD_WORDS << 2 ? size - offset : EB_MAX_RECORD_WORDS << 2;
+
+        // Create the header, the data is sent directly from the buffer
+        memcpy(header, etherbone_header, sizeof(header));
+        header[10] = chunk >> 2;
+        uint32_t base = htobe32(address + offset);
+        memcpy(&header[12], &base, sizeof(base));
+        struct iovec iov[2] = {
+            {.iov_base = header,                   .iov_len = sizeof(header)},
+            {.iov_base = (void *) (data + offset), .iov_len = chunk}
+        };
+        if (debug) {
+            eb_print_words("Write header", header, sizeof(header));
+            eb_print_words("Write", data + offset, chunk);
+        }
 
-    retval = select(1, &rfds, NULL, NULL, &tv);
+        // Send the data to the device
+        if (eb_sendv(conn, iov, 2) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    if (retval == -1) {
-        perror("select()");
-        exit(1);
+int eb_discard_pending_packets(struct eb_connection *conn) {
+    /*
+     * Discards all packets waiting to be received, without blocking. These are the
+     * responses which arrived after the read has timed out. Returns the number of
+     * discarded packets.
+     */
+    uint8_t buffer[EB_MAX_PACKET_SIZE];
+    struct iovec iov = {.iov_base = buffer, .iov_len = sizeof(buffer)};
+    int count = 0;
+
+    // With UDP all waiting packets are removed with a single system call. The content
+    // of the packets is not used, so all packets are received in the same buffer.
+    if (conn->is_direct && !conn->raw && !conn->xdp) {
+        struct mmsghdr msgs[EB_MAX_BATCH];
+        memset(msgs, 0, sizeof(msgs));
+        for (int i=0; i<EB_MAX_BATCH; i++) {
+            msgs[i].msg_hdr.msg_iov = &iov;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        while (1) {
+            int r = recvmmsg(conn->read_fd, msgs, EB_MAX_BATCH, MSG_DONTWAIT, NULL);
+            if (r <= 0)
+                return count;
+            count += r;
+        }
     }
-    
-    if (retval > 0) {
-        // read data and ignore
-        int rc = eb_recv(conn, buffer, sizeof(buffer));
-        fprintf(stderr,"colorcnc: found qeued packet. Ignore that data, size %d\n", rc);
+
+    while (1) {
+        int r;
+        if (conn->raw)
+            r = eb_raw_recvv(conn->raw, &iov, 1, 0);
+        else if (conn->xdp)
+            r = eb_xdp_recvv(conn->xdp, &iov, 1, 0);
+        else if (conn->is_direct)
+            r = recvfrom(conn->read_fd, buffer, sizeof(buffer), MSG_DONTWAIT, NULL, NULL);
+        else
+            r = recv(conn->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (r < 0)
+            return count;
+        count++;
     }
 }
 
@@ -274,7 +580,9 @@ struct eb_connection *eb_connect(const char *addr, const char *port, int is_dire
         return NULL;
     }
 
+    memset(conn, 0, sizeof(struct eb_connection));
     conn->is_direct = is_direct;
+    conn->tx_gap_ns = EB_DEFAULT_TX_GAP_NS;
 
     if (is_direct) {
         // Rx half
@@ -292,6 +600,10 @@ struct eb_connection *eb_connect(const char *addr, const char *port, int is_dire
             free(conn);
             return NULL;
         }
+        // All boards respond to the same port. Each board gets its own socket, which
+        // is connected to the board, so it only receives the packets of that board.
+        int reuse = 1;
+        setsockopt(rx_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
         if (bind(rx_socket, (struct sockaddr*)&si_me, sizeof(si_me)) == -1) {
             fprintf(stderr, "Unable to bind Rx socket to port: %s\n", strerror(errno));
             close(rx_socket);
@@ -299,17 +611,15 @@ struct eb_connection *eb_connect(const char *addr, const char *port, int is_dire
             free(conn);
             return NULL;
         }
-		struct timeval timeout;
-		timeout.tv_sec = 0;        
-		timeout.tv_usec = 10000; //FIRST_PACKETS
-		err = setsockopt(rx_socket, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
-		if (err < 0) {
+        if (connect(rx_socket, res->ai_addr, res->ai_addrlen) == -1) {
+            fprintf(stderr, "Unable to connect Rx socket to board: %s\n", strerror(errno));
             close(rx_socket);
             freeaddrinfo(res);
-            fprintf(stderr,"etherbone: unable set socket: %s\n", strerror(errno));
             free(conn);
             return NULL;
-		}
+        }
+        // NOTE: the socket has no receive timeout, the packets are received without
+        // blocking and the waiting is bounded by the deadline (see `eb_recvv`)
 		
         // Tx half
         int tx_socket = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
@@ -323,6 +633,8 @@ struct eb_connection *eb_connect(const char *addr, const char *port, int is_dire
             return NULL;
         }
 
+		struct timeval timeout;
+		timeout.tv_sec = 0;
 		timeout.tv_usec = SEND_TIMEOUT_US;
 		err = setsockopt(tx_socket, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof(timeout));
 		if (err < 0) {
@@ -334,6 +646,14 @@ struct eb_connection *eb_connect(const char *addr, const char *port, int is_dire
             return NULL;
 		}
 
+#ifdef SO_TXTIME
+        // Enable scheduled transmission. This only has effect when the launch time is
+        // used and an ETF qdisc has been configured on the interface for the packets
+        // with priority EB_TXTIME_PRIORITY.
+        struct sock_txtime txtime_config = {.clockid = CLOCK_TAI, .flags = 0};
+        conn->txtime_available = setsockopt(tx_socket, SOL_SOCKET, SO_TXTIME, &txtime_config, sizeof(txtime_config)) == 0;
+#endif
+
         conn->read_fd = rx_socket;
         conn->fd = tx_socket;
         conn->addr = res;
@@ -363,10 +683,64 @@ struct eb_connection *eb_connect(const char *addr, const char *port, int is_dire
     return conn;
 }
 
+struct eb_connection *eb_connect_raw(const char *ifname, const char *addr, const char *port, uint64_t mac_address) {
+
+    struct eb_connection *conn = malloc(sizeof(struct eb_connection));
+    if (!conn) {
+        perror("couldn't allocate memory for eb_connection");
+        return NULL;
+    }
+    memset(conn, 0, sizeof(struct eb_connection));
+    conn->is_direct = 1;
+    conn->tx_gap_ns = EB_DEFAULT_TX_GAP_NS;
+
+    conn->raw = eb_raw_open(ifname, addr, port, mac_address);
+    if (!conn->raw) {
+        free(conn);
+        return NULL;
+    }
+
+    return conn;
+}
+
+struct eb_connection *eb_connect_xdp(const char *ifname, const char *addr, const char *port, uint64_t mac_address) {
+
+    struct eb_connection *conn = malloc(sizeof(struct eb_connection));
+    if (!conn) {
+        perror("couldn't allocate memory for eb_connection");
+        return NULL;
+    }
+    memset(conn, 0, sizeof(struct eb_connection));
+    conn->is_direct = 1;
+    conn->tx_gap_ns = EB_DEFAULT_TX_GAP_NS;
+
+    conn->xdp = eb_xdp_open(ifname, addr, port, mac_address);
+    if (!conn->xdp) {
+        free(conn);
+        return NULL;
+    }
+
+    return conn;
+}
+
 void eb_disconnect(struct eb_connection **conn) {
     if (!conn || !*conn)
         return;
 
+    if ((*conn)->xdp) {
+        eb_xdp_close((*conn)->xdp);
+        free(*conn);
+        *conn = NULL;
+        return;
+    }
+
+    if ((*conn)->raw) {
+        eb_raw_close((*conn)->raw);
+        free(*conn);
+        *conn = NULL;
+        return;
+    }
+
     freeaddrinfo((*conn)->addr);
     close((*conn)->fd);
     if ((*conn)->read_fd)
@@ -6,6 +6,7 @@ extern "C" {
 #endif /* __cplusplus */
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 /*
 
@@ -55,25 +56,83 @@ LiteX only supports a single record per packet, so either wcount or rcount
 is set to 1.  For a read, the read_addr is specified.  For a write, the
 write_addr is specified along with a value.
 
+A single record can contain both writes and reads. In that case the writes
+(write_addr followed by wcount values) come first, followed by the return
+address and the rcount addresses to read. The writes are performed before
+the reads, so the response contains the data after the write.
+
 The same type of record is returned, so your data is at offset 16.
+
+The counts are a single byte, so a record reads or writes at most 255 words. Larger
+transfers are split over multiple packets, each with its own record.
+
+The LitexCNC firmware extends the record with burst reads. When the rff flag is set,
+the return address is followed by only the address of the first word to read, after
+which rcount consecutive words are read. The size of the request then no longer
+depends on the number of words read.
 */
 #define SEND_TIMEOUT_US 10
+// The default minimum time between two packets. The colorlight card crashes when two
+// packets come close to each other.
+#define EB_DEFAULT_TX_GAP_NS 10000
+// The time between passing a packet to the kernel and its launch time when scheduled
+// transmission (SO_TXTIME) is used.
+#define EB_TXTIME_MARGIN_NS 10000
+// The priority of the packets with a launch time (SO_PRIORITY), which the qdisc maps to
+// the queue with the ETF qdisc. Priorities up to 6 can be set without CAP_NET_ADMIN.
+#define EB_TXTIME_PRIORITY 6
+// The maximum size of a packet received from the board
+#define EB_MAX_PACKET_SIZE 2048
+// The maximum number of words read or written by a single record (the counts in the
+// record are a single byte)
+#define EB_MAX_RECORD_WORDS 255
+// The maximum size of an Etherbone packet which fits in a single Ethernet frame
+// (MTU of 1500 bytes minus the IP and UDP headers)
+#define EB_MAX_PAYLOAD_SIZE 1472
+// Flag of the record for burst reads (LitexCNC extension)
+#define EB_FLAG_RFF 0x04
+// The maximum number of packets sent or received with a single system call
+#define EB_MAX_BATCH 16
+// The time a receive waits for a packet when no deadline has been set
+#define EB_RECV_TIMEOUT_NS 10000000
+// The time the kernel polls the network card for packets in busy-poll mode (SO_BUSY_POLL)
+#define EB_BUSY_POLL_US 50
 
 struct eb_connection;
 static const uint8_t etherbone_header[16] = { 0x4e, 0x6f, 0x10, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f };
 
 int eb_send(struct eb_connection *conn, const void *bytes, size_t len);
+int eb_sendv(struct eb_connection *conn, const struct iovec *iov, int iovcnt);
 int eb_recv(struct eb_connection *conn, void *bytes, size_t max_len);
+int eb_recvv(struct eb_connection *conn, const struct iovec *iov, int iovcnt);
+int eb_send_batch(struct eb_connection **conns, struct iovec *const *iovs, const int *iovcnts, int count, int *failed);
+int eb_get_fd(struct eb_connection *conn);
+
+// Buffers in the memory of the transport, so packets can be written and read in place
+// (without copying). Only supported by the AF_XDP transport, `eb_alloc_tx_buffer`
+// returns NULL for the other transports.
+uint8_t *eb_alloc_tx_buffer(struct eb_connection *conn);
+int eb_send_tx_buffer(struct eb_connection *conn, uint8_t *buffer, size_t len);
+int eb_recv_in_place(struct eb_connection *conn, uint8_t **buffer);
+void eb_release_rx_buffer(struct eb_connection *conn, uint8_t *buffer);
 
 int eb_create_packet(uint8_t* eth_buffer, uint32_t address, const uint8_t* data, size_t size, int is_read);
-void eb_write8(struct eb_connection *conn, uint32_t address, const uint8_t* data, size_t size, bool debug);
+int eb_write8(struct eb_connection *conn, uint32_t address, const uint8_t* data, size_t size, bool debug);
 int eb_read8(struct eb_connection *conn, uint32_t address, uint8_t* data, size_t size, bool debug);
 void usecSleep(long usec);
 
-void eb_wait_for_tx_buffer_empty(struct eb_connection *conn);
-void eb_discard_pending_packet(struct eb_connection *conn, size_t size);
+void eb_set_tx_gap(struct eb_connection *conn, uint32_t gap_ns, int use_txtime);
+// The receive functions give up at the deadline (CLOCK_MONOTONIC, in nanoseconds). When
+// the deadline is 0, they wait at most EB_RECV_TIMEOUT_NS. In busy-poll mode the thread
+// spins on the socket until the deadline instead of sleeping, which is meant for
+// isolated cores.
+void eb_set_rx_deadline(struct eb_connection *conn, uint64_t deadline_ns);
+void eb_set_busy_poll(struct eb_connection *conn, int busy_poll);
+int eb_discard_pending_packets(struct eb_connection *conn);
 
 struct eb_connection *eb_connect(const char *addr, const char *port, int is_direct);
+struct eb_connection *eb_connect_raw(const char *ifname, const char *addr, const char *port, uint64_t mac_address);
+struct eb_connection *eb_connect_xdp(const char *ifname, const char *addr, const char *port, uint64_t mac_address);
 void eb_disconnect(struct eb_connection **conn);
 
 #ifdef __cplusplus
@@ -0,0 +1,375 @@
+#if defined(__FreeBSD__)
+#include <sys/endian.h>
+#else
+#include <endian.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#include "etherbone_raw.h"
+
+struct eb_raw {
+    int fd;
+    int ifindex;
+    // The memory mapped rings, the RX ring is followed by the TX ring
+    uint8_t *ring;
+    size_t ring_size;
+    struct tpacket_req req;
+    size_t rx_index;
+    size_t tx_index;
+    // Addresses used to filter the received frames (network order)
+    uint32_t board_ip;
+    uint16_t port;
+    // The prebuilt Ethernet, IP and UDP headers
+    uint8_t header[EB_RAW_HEADER_SIZE];
+};
+
+
+// Offset of the data in a frame of the ring, see the kernel documentation on
+// PACKET_MMAP (packet_mmap.rst)
+#define EB_RAW_DATA_OFFSET (TPACKET_ALIGN(sizeof(struct tpacket2_hdr)))
+
+
+static inline struct tpacket2_hdr *eb_raw_rx_frame(struct eb_raw *raw, size_t index) {
+    return (struct tpacket2_hdr *) (raw->ring + index * EB_RAW_FRAME_SIZE);
+}
+
+
+static inline struct tpacket2_hdr *eb_raw_tx_frame(struct eb_raw *raw, size_t index) {
+    return (struct tpacket2_hdr *) (raw->ring + (raw->req.tp_frame_nr + index) * EB_RAW_FRAME_SIZE);
+}
+
+
+static uint16_t eb_frame_ip_checksum(const uint8_t *header) {
+    // One's complement sum of the 20 bytes of the IP-header
+    uint32_t sum = 0;
+    for (size_t i=0; i<20; i+=2) {
+        sum += (header[i] << 8) | header[i+1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+
+static int eb_raw_attach_filter(struct eb_raw *raw) {
+    /*
+     * Only pass the UDP-packets from the board to the requested port to the RX ring,
+     * all other traffic on the interface is dropped by the kernel.
+     */
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 12),                                 // Ethertype
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   ETH_P_IP, 0, 8),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 23),                                 // IP protocol
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, 26),                                 // IP source
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   be32toh(raw->board_ip), 0, 4),
+        BPF_STMT(BPF_LDX | BPF_B   | BPF_MSH, 14),                                 // IP header length
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 16),                                 // UDP destination port
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   be16toh(raw->port), 0, 1),
+        BPF_STMT(BPF_RET | BPF_K,             0x40000),
+        BPF_STMT(BPF_RET | BPF_K,             0),
+    };
+    struct sock_fprog program = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code
+    };
+    return setsockopt(raw->fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program));
+}
+
+
+int eb_frame_get_interface(const char *ifname, int *ifindex, uint8_t *mac, uint32_t *ip) {
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    // - index
+    if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+        fprintf(stderr, "etherbone: unknown interface '%s': %s\n", ifname, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    *ifindex = ifr.ifr_ifindex;
+    // - MAC-address
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+        fprintf(stderr, "etherbone: cannot get MAC-address of '%s': %s\n", ifname, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    memcpy(mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+    // - IP-address
+    ifr.ifr_addr.sa_family = AF_INET;
+    if (ioctl(fd, SIOCGIFADDR, &ifr) < 0) {
+        fprintf(stderr, "etherbone: cannot get IP-address of '%s': %s\n", ifname, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    *ip = ((struct sockaddr_in *) &ifr.ifr_addr)->sin_addr.s_addr;
+    close(fd);
+    return 0;
+}
+
+
+void eb_frame_build_header(uint8_t *header, uint64_t mac_address, const uint8_t *if_mac, uint32_t if_ip, uint32_t board_ip, uint16_t port) {
+    /*
+     * Creates the Ethernet, IP and UDP headers for the frames to the board. The lengths
+     * and the checksum are set when the frame is sent (eb_frame_finish).
+     */
+    memset(header, 0, EB_RAW_HEADER_SIZE);
+    // - Ethernet
+    for (size_t i=0; i<ETH_ALEN; i++) {
+        header[i] = (mac_address >> (8 * (ETH_ALEN - 1 - i))) & 0xff;
+    }
+    memcpy(&header[6], if_mac, ETH_ALEN);
+    header[12] = ETH_P_IP >> 8;
+    header[13] = ETH_P_IP & 0xff;
+    // - IP
+    header[14] = 0x45;                      // Version 4, header of 5 words
+    header[20] = 0x40;                      // Don't fragment
+    header[22] = 64;                        // Time to live
+    header[23] = IPPROTO_UDP;
+    memcpy(&header[26], &if_ip, 4);
+    memcpy(&header[30], &board_ip, 4);
+    // - UDP (checksum is not used)
+    memcpy(&header[34], &port, 2);
+    memcpy(&header[36], &port, 2);
+}
+
+
+void eb_frame_finish(uint8_t *frame, size_t len) {
+    // Patch the lengths and the checksum for a payload of the given length
+    uint16_t ip_len = htobe16(len + 28);
+    uint16_t udp_len = htobe16(len + 8);
+    memcpy(&frame[16], &ip_len, 2);
+    memcpy(&frame[38], &udp_len, 2);
+    frame[24] = 0;
+    frame[25] = 0;
+    uint16_t checksum = htobe16(eb_frame_ip_checksum(&frame[14]));
+    memcpy(&frame[24], &checksum, 2);
+}
+
+
+int eb_frame_parse(const uint8_t *frame, size_t len, uint32_t board_ip, uint16_t port, const uint8_t **payload) {
+    /*
+     * Checks whether the frame is an UDP-packet from the board to the given port. Returns
+     * the length of the payload (and sets the pointer to the payload) or -1 when the 
+     * frame is not from the board.
+     */
+    if (len < EB_RAW_HEADER_SIZE || frame[12] != (ETH_P_IP >> 8) || frame[13] != (ETH_P_IP & 0xff)) {
+        return -1;
+    }
+    size_t ip_header_size = (frame[14] & 0x0f) << 2;
+    const uint8_t *udp = frame + 14 + ip_header_size;
+    uint16_t udp_len;
+    memcpy(&udp_len, udp + 4, 2);
+    udp_len = be16toh(udp_len);
+    if (frame[23] != IPPROTO_UDP || memcmp(&frame[26], &board_ip, 4) != 0 || memcmp(udp + 2, &port, 2) != 0
+        || udp_len < 8 || 14 + ip_header_size + udp_len > len) {
+        return -1;
+    }
+    *payload = udp + 8;
+    return udp_len - 8;
+}
+
+
+struct eb_raw *eb_raw_open(const char *ifname, const char *addr, const char *port, uint64_t mac_address) {
+
+    uint8_t if_mac[ETH_ALEN];
+    uint32_t if_ip;
+
+    struct eb_raw *raw = malloc(sizeof(struct eb_raw));
+    if (!raw) {
+        perror("couldn't allocate memory for eb_raw");
+        return NULL;
+    }
+    memset(raw, 0, sizeof(struct eb_raw));
+    raw->fd = -1;
+
+    // Addresses of the board
+    if (inet_pton(AF_INET, addr, &raw->board_ip) != 1) {
+        fprintf(stderr, "etherbone: invalid IP-address '%s'\n", addr);
+        goto fail;
+    }
+    raw->port = htobe16(atoi(port));
+
+    // Addresses of the interface
+    if (eb_frame_get_interface(ifname, &raw->ifindex, if_mac, &if_ip) < 0) {
+        goto fail;
+    }
+
+    // Create the socket and bind it to the interface. The filter is attached before
+    // binding, so no other traffic enters the RX ring.
+    raw->fd = socket(AF_PACKET, SOCK_RAW, htobe16(ETH_P_IP));
+    if (raw->fd < 0) {
+        fprintf(stderr, "etherbone: unable to create raw socket: %s\n", strerror(errno));
+        goto fail;
+    }
+    if (eb_raw_attach_filter(raw) < 0) {
+        fprintf(stderr, "etherbone: unable to attach filter: %s\n", strerror(errno));
+        goto fail;
+    }
+    int version = TPACKET_V2;
+    if (setsockopt(raw->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        fprintf(stderr, "etherbone: unable to set TPACKET_V2: %s\n", strerror(errno));
+        goto fail;
+    }
+    // Packets sent by this socket should not be looped back to the RX ring
+#ifdef PACKET_IGNORE_OUTGOING
+    int ignore_outgoing = 1;
+    setsockopt(raw->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore_outgoing, sizeof(ignore_outgoing));
+#endif
+
+    // Create the rings (same size for RX and TX)
+    raw->req.tp_block_size = EB_RAW_FRAME_SIZE * EB_RAW_FRAME_COUNT;
+    raw->req.tp_block_nr   = 1;
+    raw->req.tp_frame_size = EB_RAW_FRAME_SIZE;
+    raw->req.tp_frame_nr   = EB_RAW_FRAME_COUNT;
+    if (setsockopt(raw->fd, SOL_PACKET, PACKET_RX_RING, &raw->req, sizeof(raw->req)) < 0 ||
+        setsockopt(raw->fd, SOL_PACKET, PACKET_TX_RING, &raw->req, sizeof(raw->req)) < 0) {
+        fprintf(stderr, "etherbone: unable to create packet rings: %s\n", strerror(errno));
+        goto fail;
+    }
+    raw->ring_size = 2 * raw->req.tp_block_size * raw->req.tp_block_nr;
+    raw->ring = mmap(NULL, raw->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, raw->fd, 0);
+    if (raw->ring == MAP_FAILED) {
+        raw->ring = NULL;
+        fprintf(stderr, "etherbone: unable to map packet rings: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_protocol = htobe16(ETH_P_IP);
+    sll.sll_ifindex  = raw->ifindex;
+    if (bind(raw->fd, (struct sockaddr *) &sll, sizeof(sll)) < 0) {
+        fprintf(stderr, "etherbone: unable to bind to '%s': %s\n", ifname, strerror(errno));
+        goto fail;
+    }
+
+    // Prebuild the headers
+    eb_frame_build_header(raw->header, mac_address, if_mac, if_ip, raw->board_ip, raw->port);
+    // - write the headers in all frames of the TX ring
+    for (size_t i=0; i<raw->req.tp_frame_nr; i++) {
+        memcpy((uint8_t *) eb_raw_tx_frame(raw, i) + EB_RAW_DATA_OFFSET, raw->header, EB_RAW_HEADER_SIZE);
+    }
+
+    return raw;
+
+fail:
+    eb_raw_close(raw);
+    return NULL;
+}
+
+
+int eb_raw_sendv(struct eb_raw *raw, const struct iovec *iov, int iovcnt) {
+    struct tpacket2_hdr *hdr = eb_raw_tx_frame(raw, raw->tx_index);
+
+    // The frame is still in use by the kernel. This should not happen, as the frames
+    // are sent directly.
+    if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    // Copy the payload behind the prebuilt header
+    uint8_t *frame = (uint8_t *) hdr + EB_RAW_DATA_OFFSET;
+    size_t len = 0;
+    for (int i=0; i<iovcnt; i++) {
+        if (EB_RAW_HEADER_SIZE + len + iov[i].iov_len > EB_RAW_FRAME_SIZE - EB_RAW_DATA_OFFSET) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        memcpy(frame + EB_RAW_HEADER_SIZE + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+
+    // Patch the lengths and the checksum
+    eb_frame_finish(frame, len);
+
+    // Hand the frame over to the kernel and kick the transmission
+    hdr->tp_len = EB_RAW_HEADER_SIZE + len;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    raw->tx_index = (raw->tx_index + 1) % raw->req.tp_frame_nr;
+    if (send(raw->fd, NULL, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN) {
+        return -1;
+    }
+    return len;
+}
+
+
+size_t eb_frame_scatter(const uint8_t *payload, size_t len, const struct iovec *iov, int iovcnt) {
+    // Copies the payload of a frame to the buffers, returns the number of bytes copied
+    size_t count = 0;
+    for (int i=0; i<iovcnt && count<len; i++) {
+        size_t part = len - count < iov[i].iov_len ? len - count : iov[i].iov_len;
+        memcpy(iov[i].iov_base, payload + count, part);
+        count += part;
+    }
+    return count;
+}
+
+
+int eb_raw_recvv(struct eb_raw *raw, const struct iovec *iov, int iovcnt, int timeout_ms) {
+    while (1) {
+        struct tpacket2_hdr *hdr = eb_raw_rx_frame(raw, raw->rx_index);
+
+        // Wait for a frame to arrive
+        if (!(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            struct pollfd pfd = {.fd = raw->fd, .events = POLLIN};
+            int r = poll(&pfd, 1, timeout_ms);
+            if (r <= 0) {
+                errno = r == 0 ? EAGAIN : errno;
+                return -1;
+            }
+            continue;
+        }
+
+        // Check the frame is from the board (the filter should have dropped all others)
+        const uint8_t *payload;
+        int count = eb_frame_parse((uint8_t *) hdr + hdr->tp_mac, hdr->tp_snaplen, raw->board_ip, raw->port, &payload);
+        if (count >= 0) {
+            count = eb_frame_scatter(payload, count, iov, iovcnt);
+        }
+
+        // Return the frame to the kernel
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        raw->rx_index = (raw->rx_index + 1) % raw->req.tp_frame_nr;
+        if (count >= 0) {
+            return count;
+        }
+    }
+}
+
+
+int eb_raw_get_fd(struct eb_raw *raw) {
+    return raw->fd;
+}
+
+
+void eb_raw_close(struct eb_raw *raw) {
+    if (!raw)
+        return;
+    if (raw->ring)
+        munmap(raw->ring, raw->ring_size);
+    if (raw->fd >= 0)
+        close(raw->fd);
+    free(raw);
+}
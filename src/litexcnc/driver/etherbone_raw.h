@@ -0,0 +1,70 @@
+#ifndef __ETHERBONE_RAW_H__
+#define __ETHERBONE_RAW_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+
+The raw transport sends the Etherbone packets as complete Ethernet frames over an
+AF_PACKET socket, bypassing the IP/UDP stack (routing, ARP cache, socket queues)
+of the kernel. The frames are exchanged through memory mapped RX and TX rings
+(PACKET_MMAP, TPACKET_V2).
+
+The Ethernet, IP and UDP headers are the same for each frame to the board, except
+for the lengths and the IP checksum. These headers are therefore written once in
+all frames of the TX ring, for each packet only the payload, the lengths and the
+checksum are written.
+
+The frame looks like this:
+
+struct eb_raw_frame {
+    uint8_t  eth_dst[6];     // MAC-address of the board
+    uint8_t  eth_src[6];     // MAC-address of the interface
+    uint16_t eth_type;       // 0x0800 (IPv4)
+    uint8_t  ip_ver_ihl;     // 0x45
+    uint8_t  ip_tos;
+    uint16_t ip_len;         // Patched per packet
+    uint16_t ip_id;
+    uint16_t ip_frag;        // Don't fragment
+    uint8_t  ip_ttl;
+    uint8_t  ip_proto;       // 17 (UDP)
+    uint16_t ip_checksum;    // Patched per packet
+    uint32_t ip_src;         // IP-address of the interface
+    uint32_t ip_dst;         // IP-address of the board
+    uint16_t udp_src;
+    uint16_t udp_dst;
+    uint16_t udp_len;        // Patched per packet
+    uint16_t udp_checksum;   // Not used (0)
+    uint8_t  payload[];      // The Etherbone packet
+} __attribute__((packed));
+
+*/
+#define EB_RAW_HEADER_SIZE 42
+#define EB_RAW_FRAME_SIZE 2048
+#define EB_RAW_FRAME_COUNT 16
+
+struct eb_raw;
+
+// Helpers for building and parsing the frames, shared with the AF_XDP transport
+int eb_frame_get_interface(const char *ifname, int *ifindex, uint8_t *mac, uint32_t *ip);
+void eb_frame_build_header(uint8_t *header, uint64_t mac_address, const uint8_t *if_mac, uint32_t if_ip, uint32_t board_ip, uint16_t port);
+void eb_frame_finish(uint8_t *frame, size_t len);
+int eb_frame_parse(const uint8_t *frame, size_t len, uint32_t board_ip, uint16_t port, const uint8_t **payload);
+size_t eb_frame_scatter(const uint8_t *payload, size_t len, const struct iovec *iov, int iovcnt);
+
+struct eb_raw *eb_raw_open(const char *ifname, const char *addr, const char *port, uint64_t mac_address);
+int eb_raw_sendv(struct eb_raw *raw, const struct iovec *iov, int iovcnt);
+int eb_raw_recvv(struct eb_raw *raw, const struct iovec *iov, int iovcnt, int timeout_ms);
+int eb_raw_get_fd(struct eb_raw *raw);
+void eb_raw_close(struct eb_raw *raw);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* __ETHERBONE_RAW_H__ */
@@ -0,0 +1,610 @@
+#if defined(__FreeBSD__)
+#include <sys/endian.h>
+#else
+#include <endian.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <linux/if_ether.h>
+
+#include "etherbone_raw.h"
+#include "etherbone_xdp.h"
+
+#ifdef EB_WITH_XDP
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+struct eb_xdp_ring {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *ring;
+    // Local copy of the producer (fill and TX ring) or the consumer (RX and
+    // completion ring)
+    uint32_t cached;
+    // The memory mapping of the ring
+    void *map;
+    size_t map_size;
+};
+
+struct eb_xdp {
+    int fd;
+    int ifindex;
+    int map_fd;
+    int prog_fd;
+    int link_fd;
+    int zero_copy;
+    int need_wakeup;
+    // The UMEM and its rings
+    uint8_t *umem;
+    size_t umem_size;
+    struct eb_xdp_ring fill;
+    struct eb_xdp_ring comp;
+    struct eb_xdp_ring rx;
+    struct eb_xdp_ring tx;
+    // The free TX frames (addresses in the UMEM)
+    uint64_t tx_free[EB_XDP_FRAME_COUNT / 2];
+    size_t tx_free_count;
+    // Addresses used to filter the received frames (network order)
+    uint32_t board_ip;
+    uint16_t port;
+    // The flow rule which steers the frames of the board to the first queue of the
+    // interface (-1 when no rule has been added)
+    char ifname[IFNAMSIZ];
+    int rule_location;
+};
+
+
+// Helpers to write the XDP program. The program is so small, that it is written
+// directly in eBPF instructions, which removes the need for a BPF compiler and
+// libbpf/libxdp.
+#define EB_BPF_INSN(CODE, DST, SRC, OFF, IMM) \
+    ((struct bpf_insn) {.code = (CODE), .dst_reg = (DST), .src_reg = (SRC), .off = (OFF), .imm = (IMM)})
+#define EB_BPF_LDX(SIZE, DST, SRC, OFF)   EB_BPF_INSN(BPF_LDX | BPF_MEM | (SIZE), DST, SRC, OFF, 0)
+#define EB_BPF_MOV_REG(DST, SRC)          EB_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, DST, SRC, 0, 0)
+#define EB_BPF_MOV_IMM(DST, IMM)          EB_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, DST, 0, 0, IMM)
+#define EB_BPF_ADD_IMM(DST, IMM)          EB_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, DST, 0, 0, IMM)
+#define EB_BPF_JGT_REG(DST, SRC, OFF)     EB_BPF_INSN(BPF_JMP | BPF_JGT | BPF_X, DST, SRC, OFF, 0)
+#define EB_BPF_JNE32_IMM(DST, IMM, OFF)   EB_BPF_INSN(BPF_JMP32 | BPF_JNE | BPF_K, DST, 0, OFF, IMM)
+#define EB_BPF_LD_MAP_FD(DST, FD)         EB_BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, DST, BPF_PSEUDO_MAP_FD, 0, FD), \
+                                          EB_BPF_INSN(0, 0, 0, 0, 0)
+#define EB_BPF_CALL(FUNC)                 EB_BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, FUNC)
+#define EB_BPF_EXIT()                     EB_BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+
+static int eb_xdp_bpf(int cmd, union bpf_attr *attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+
+static int eb_xdp_ethtool(const char *ifname, void *data) {
+    // Performs an ethtool command on the interface
+    struct ifreq ifr;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    ifr.ifr_data = data;
+    int r = ioctl(fd, SIOCETHTOOL, &ifr);
+    int error = errno;
+    close(fd);
+    errno = error;
+    return r;
+}
+
+
+static int eb_xdp_steer_to_queue(struct eb_xdp *xdp) {
+    /*
+     * The socket is bound to the first queue of the interface, frames received on the
+     * other queues are passed to the kernel and never reach the socket. When the
+     * interface has more than one receive queue, the frames of the board are steered to
+     * the first queue with a flow rule (ntuple filter), which is removed when the
+     * connection is closed.
+     */
+    struct ethtool_channels channels;
+    memset(&channels, 0, sizeof(channels));
+    channels.cmd = ETHTOOL_GCHANNELS;
+    if (eb_xdp_ethtool(xdp->ifname, &channels) < 0) {
+        // The queues are not reported, which is the case for interfaces with a single queue
+        return 0;
+    }
+    uint32_t queues = channels.rx_count + channels.combined_count;
+    if (queues <= 1) {
+        return 0;
+    }
+
+    struct ethtool_rxnfc rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.cmd = ETHTOOL_SRXCLSRLINS;
+    rule.fs.flow_type = UDP_V4_FLOW;
+    rule.fs.h_u.udp_ip4_spec.ip4src = xdp->board_ip;
+    rule.fs.m_u.udp_ip4_spec.ip4src = 0xFFFFFFFF;
+    rule.fs.h_u.udp_ip4_spec.pdst = xdp->port;
+    rule.fs.m_u.udp_ip4_spec.pdst = 0xFFFF;
+    rule.fs.ring_cookie = 0;
+    rule.fs.location = RX_CLS_LOC_ANY;
+    if (eb_xdp_ethtool(xdp->ifname, &rule) < 0) {
+        fprintf(stderr,
+            "etherbone: interface '%s' has %u receive queues and the frames of the board cannot be "
+            "steered to queue 0 (%s). Use a single queue (`ethtool -L %s combined 1`) or add a flow "
+            "rule to queue 0 (`ethtool -N %s flow-type udp4 src-ip <board> dst-port <port> action 0`)\n",
+            xdp->ifname, queues, strerror(errno), xdp->ifname, xdp->ifname);
+        return -1;
+    }
+    xdp->rule_location = rule.fs.location;
+    return 0;
+}
+
+
+static int eb_xdp_load_program(struct eb_xdp *xdp) {
+    /*
+     * Creates the map with the socket and loads the program which redirects the frames
+     * from the board to the socket. All other frames are passed to the kernel. The
+     * values to compare with are the values as they are in memory (network order).
+     */
+    union bpf_attr attr;
+    uint16_t ethertype = htobe16(ETH_P_IP);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size    = sizeof(uint32_t);
+    attr.value_size  = sizeof(uint32_t);
+    attr.max_entries = 64;
+    xdp->map_fd = eb_xdp_bpf(BPF_MAP_CREATE, &attr);
+    if (xdp->map_fd < 0) {
+        fprintf(stderr, "etherbone: unable to create XSK map: %s\n", strerror(errno));
+        return -1;
+    }
+
+    struct bpf_insn program[] = {
+        EB_BPF_LDX(BPF_W, BPF_REG_2, BPF_REG_1, 0),                     // r2 = ctx->data
+        EB_BPF_LDX(BPF_W, BPF_REG_3, BPF_REG_1, 4),                     // r3 = ctx->data_end
+        EB_BPF_MOV_REG(BPF_REG_4, BPF_REG_2),
+        EB_BPF_ADD_IMM(BPF_REG_4, EB_RAW_HEADER_SIZE),
+        EB_BPF_JGT_REG(BPF_REG_4, BPF_REG_3, 16),                       // frame too short
+        EB_BPF_LDX(BPF_H, BPF_REG_4, BPF_REG_2, 12),                    // ethertype
+        EB_BPF_JNE32_IMM(BPF_REG_4, ethertype, 14),
+        EB_BPF_LDX(BPF_B, BPF_REG_4, BPF_REG_2, 14),                    // IPv4, no options
+        EB_BPF_JNE32_IMM(BPF_REG_4, 0x45, 12),
+        EB_BPF_LDX(BPF_B, BPF_REG_4, BPF_REG_2, 23),                    // UDP
+        EB_BPF_JNE32_IMM(BPF_REG_4, IPPROTO_UDP, 10),
+        EB_BPF_LDX(BPF_W, BPF_REG_4, BPF_REG_2, 26),                    // source is the board
+        EB_BPF_JNE32_IMM(BPF_REG_4, (int32_t) xdp->board_ip, 8),
+        EB_BPF_LDX(BPF_H, BPF_REG_4, BPF_REG_2, 36),                    // destination port
+        EB_BPF_JNE32_IMM(BPF_REG_4, xdp->port, 6),
+        EB_BPF_LDX(BPF_W, BPF_REG_2, BPF_REG_1, 16),                    // r2 = ctx->rx_queue_index
+        EB_BPF_LD_MAP_FD(BPF_REG_1, xdp->map_fd),
+        EB_BPF_MOV_IMM(BPF_REG_3, XDP_PASS),                            // pass when no socket
+        EB_BPF_CALL(BPF_FUNC_redirect_map),
+        EB_BPF_EXIT(),
+        EB_BPF_MOV_IMM(BPF_REG_0, XDP_PASS),                            // all other frames
+        EB_BPF_EXIT(),
+    };
+    char log[4096] = "";
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns     = (uint64_t) (uintptr_t) program;
+    attr.insn_cnt  = sizeof(program) / sizeof(program[0]);
+    attr.license   = (uint64_t) (uintptr_t) "GPL";
+    attr.log_buf   = (uint64_t) (uintptr_t) log;
+    attr.log_size  = sizeof(log);
+    attr.log_level = 1;
+    xdp->prog_fd = eb_xdp_bpf(BPF_PROG_LOAD, &attr);
+    if (xdp->prog_fd < 0) {
+        fprintf(stderr, "etherbone: unable to load XDP program: %s\n%s\n", strerror(errno), log);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int eb_xdp_attach_program(struct eb_xdp *xdp) {
+    union bpf_attr attr;
+
+    // Put the socket in the map, the frames are received on queue 0
+    uint32_t key = 0;
+    uint32_t value = xdp->fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = xdp->map_fd;
+    attr.key    = (uint64_t) (uintptr_t) &key;
+    attr.value  = (uint64_t) (uintptr_t) &value;
+    attr.flags  = BPF_ANY;
+    if (eb_xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        fprintf(stderr, "etherbone: unable to add socket to XSK map: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // Attach the program to the interface, preferably in the driver of the network
+    // card. The program is detached when the link is closed.
+    const uint32_t modes[] = {XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE};
+    for (size_t i=0; i<sizeof(modes)/sizeof(modes[0]); i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd        = xdp->prog_fd;
+        attr.link_create.target_ifindex = xdp->ifindex;
+        attr.link_create.attach_type    = BPF_XDP;
+        attr.link_create.flags          = modes[i];
+        xdp->link_fd = eb_xdp_bpf(BPF_LINK_CREATE, &attr);
+        if (xdp->link_fd >= 0) {
+            return 0;
+        }
+    }
+    fprintf(stderr, "etherbone: unable to attach XDP program: %s\n", strerror(errno));
+    return -1;
+}
+
+
+static int eb_xdp_map_ring(struct eb_xdp *xdp, struct eb_xdp_ring *ring, const struct xdp_ring_offset *offset, size_t desc_size, off_t pgoff) {
+    ring->map_size = offset->desc + EB_XDP_RING_SIZE * desc_size;
+    ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xdp->fd, pgoff);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return -1;
+    }
+    ring->producer = (uint32_t *) ((uint8_t *) ring->map + offset->producer);
+    ring->consumer = (uint32_t *) ((uint8_t *) ring->map + offset->consumer);
+    ring->flags    = (uint32_t *) ((uint8_t *) ring->map + offset->flags);
+    ring->ring     = (uint8_t *) ring->map + offset->desc;
+    return 0;
+}
+
+
+// Functions for the rings written by the driver (fill and TX ring)
+static inline uint32_t eb_xdp_ring_free(struct eb_xdp_ring *ring) {
+    return EB_XDP_RING_SIZE - (ring->cached - __atomic_load_n(ring->consumer, __ATOMIC_ACQUIRE));
+}
+
+
+static inline void eb_xdp_ring_submit(struct eb_xdp_ring *ring) {
+    __atomic_store_n(ring->producer, ring->cached, __ATOMIC_RELEASE);
+}
+
+
+// Functions for the rings written by the kernel (RX and completion ring)
+static inline uint32_t eb_xdp_ring_available(struct eb_xdp_ring *ring) {
+    return __atomic_load_n(ring->producer, __ATOMIC_ACQUIRE) - ring->cached;
+}
+
+
+static inline void eb_xdp_ring_release(struct eb_xdp_ring *ring) {
+    __atomic_store_n(ring->consumer, ring->cached, __ATOMIC_RELEASE);
+}
+
+
+static inline uint64_t eb_xdp_frame_address(struct eb_xdp *xdp, const uint8_t *buffer) {
+    return (uint64_t) (buffer - xdp->umem) & ~((uint64_t) EB_XDP_FRAME_SIZE - 1);
+}
+
+
+static void eb_xdp_fill(struct eb_xdp *xdp, uint64_t address) {
+    // The fill ring is as large as the number of RX frames, so there is always room
+    ((uint64_t *) xdp->fill.ring)[xdp->fill.cached & (EB_XDP_RING_SIZE - 1)] = address;
+    xdp->fill.cached++;
+    eb_xdp_ring_submit(&xdp->fill);
+}
+
+
+static void eb_xdp_complete(struct eb_xdp *xdp) {
+    // Return the transmitted frames to the list of free TX frames
+    uint32_t available = eb_xdp_ring_available(&xdp->comp);
+    for (uint32_t i=0; i<available; i++) {
+        xdp->tx_free[xdp->tx_free_count++] = ((uint64_t *) xdp->comp.ring)[xdp->comp.cached & (EB_XDP_RING_SIZE - 1)];
+        xdp->comp.cached++;
+    }
+    if (available) {
+        eb_xdp_ring_release(&xdp->comp);
+    }
+}
+
+
+struct eb_xdp *eb_xdp_open(const char *ifname, const char *addr, const char *port, uint64_t mac_address) {
+
+    uint8_t if_mac[ETH_ALEN];
+    uint32_t if_ip;
+    uint8_t header[EB_RAW_HEADER_SIZE];
+
+    struct eb_xdp *xdp = malloc(sizeof(struct eb_xdp));
+    if (!xdp) {
+        perror("couldn't allocate memory for eb_xdp");
+        return NULL;
+    }
+    memset(xdp, 0, sizeof(struct eb_xdp));
+    xdp->fd = -1;
+    xdp->map_fd = -1;
+    xdp->prog_fd = -1;
+    xdp->link_fd = -1;
+    xdp->rule_location = -1;
+    strncpy(xdp->ifname, ifname, IFNAMSIZ - 1);
+
+    // Addresses of the board and the interface
+    if (inet_pton(AF_INET, addr, &xdp->board_ip) != 1) {
+        fprintf(stderr, "etherbone: invalid IP-address '%s'\n", addr);
+        goto fail;
+    }
+    xdp->port = htobe16(atoi(port));
+    if (eb_frame_get_interface(ifname, &xdp->ifindex, if_mac, &if_ip) < 0) {
+        goto fail;
+    }
+
+    // Create the UMEM and register it with the socket
+    xdp->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (xdp->fd < 0) {
+        fprintf(stderr, "etherbone: unable to create AF_XDP socket: %s\n", strerror(errno));
+        goto fail;
+    }
+    xdp->umem_size = EB_XDP_FRAME_SIZE * EB_XDP_FRAME_COUNT;
+    xdp->umem = mmap(NULL, xdp->umem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (xdp->umem == MAP_FAILED) {
+        xdp->umem = NULL;
+        fprintf(stderr, "etherbone: unable to allocate UMEM: %s\n", strerror(errno));
+        goto fail;
+    }
+    struct xdp_umem_reg umem_reg = {
+        .addr = (uint64_t) (uintptr_t) xdp->umem,
+        .len = xdp->umem_size,
+        .chunk_size = EB_XDP_FRAME_SIZE,
+        .headroom = 0
+    };
+    if (setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_REG, &umem_reg, sizeof(umem_reg)) < 0) {
+        fprintf(stderr, "etherbone: unable to register UMEM: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    // Create the rings and map them
+    int ring_size = EB_XDP_RING_SIZE;
+    if (setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xdp->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xdp->fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xdp->fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) < 0) {
+        fprintf(stderr, "etherbone: unable to create AF_XDP rings: %s\n", strerror(errno));
+        goto fail;
+    }
+    struct xdp_mmap_offsets offsets;
+    socklen_t offsets_size = sizeof(offsets);
+    if (getsockopt(xdp->fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &offsets_size) < 0) {
+        fprintf(stderr, "etherbone: unable to get offsets of AF_XDP rings: %s\n", strerror(errno));
+        goto fail;
+    }
+    if (eb_xdp_map_ring(xdp, &xdp->fill, &offsets.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+        eb_xdp_map_ring(xdp, &xdp->comp, &offsets.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) < 0 ||
+        eb_xdp_map_ring(xdp, &xdp->rx, &offsets.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0 ||
+        eb_xdp_map_ring(xdp, &xdp->tx, &offsets.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0) {
+        fprintf(stderr, "etherbone: unable to map AF_XDP rings: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    // The first half of the frames is used for receiving, the second half for
+    // transmitting. The headers are written once in all TX frames.
+    for (size_t i=0; i<EB_XDP_FRAME_COUNT / 2; i++) {
+        eb_xdp_fill(xdp, i * EB_XDP_FRAME_SIZE);
+    }
+    eb_frame_build_header(header, mac_address, if_mac, if_ip, xdp->board_ip, xdp->port);
+    for (size_t i=EB_XDP_FRAME_COUNT / 2; i<EB_XDP_FRAME_COUNT; i++) {
+        memcpy(xdp->umem + i * EB_XDP_FRAME_SIZE, header, EB_RAW_HEADER_SIZE);
+        xdp->tx_free[xdp->tx_free_count++] = i * EB_XDP_FRAME_SIZE;
+    }
+
+    // Bind the socket to the first queue of the interface (see `eb_xdp_steer_to_queue`).
+    // Zero-copy is tried first, when the network card does not support this, copy mode
+    // is used.
+    const uint16_t bind_flags[] = {
+        XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP,
+        XDP_COPY | XDP_USE_NEED_WAKEUP,
+        XDP_COPY
+    };
+    size_t i;
+    for (i=0; i<sizeof(bind_flags)/sizeof(bind_flags[0]); i++) {
+        struct sockaddr_xdp sxdp = {
+            .sxdp_family = AF_XDP,
+            .sxdp_flags = bind_flags[i],
+            .sxdp_ifindex = xdp->ifindex,
+            .sxdp_queue_id = 0
+        };
+        if (bind(xdp->fd, (struct sockaddr *) &sxdp, sizeof(sxdp)) == 0) {
+            xdp->zero_copy = (bind_flags[i] & XDP_ZEROCOPY) != 0;
+            xdp->need_wakeup = (bind_flags[i] & XDP_USE_NEED_WAKEUP) != 0;
+            break;
+        }
+    }
+    if (i == sizeof(bind_flags)/sizeof(bind_flags[0])) {
+        fprintf(stderr, "etherbone: unable to bind AF_XDP socket to '%s': %s\n", ifname, strerror(errno));
+        goto fail;
+    }
+
+    // Redirect the frames of the board to the socket
+    if (eb_xdp_steer_to_queue(xdp) < 0 || eb_xdp_load_program(xdp) < 0 || eb_xdp_attach_program(xdp) < 0) {
+        goto fail;
+    }
+
+    return xdp;
+
+fail:
+    eb_xdp_close(xdp);
+    return NULL;
+}
+
+
+int eb_xdp_is_zero_copy(struct eb_xdp *xdp) {
+    return xdp->zero_copy;
+}
+
+
+int eb_xdp_get_fd(struct eb_xdp *xdp) {
+    // The socket is readable when the RX ring contains a frame
+    return xdp->fd;
+}
+
+
+uint8_t *eb_xdp_alloc_tx(struct eb_xdp *xdp) {
+    eb_xdp_complete(xdp);
+    if (xdp->tx_free_count == 0) {
+        errno = ENOBUFS;
+        return NULL;
+    }
+    return xdp->umem + xdp->tx_free[--xdp->tx_free_count] + EB_RAW_HEADER_SIZE;
+}
+
+
+int eb_xdp_submit_tx(struct eb_xdp *xdp, uint8_t *buffer, size_t len) {
+    uint64_t address = eb_xdp_frame_address(xdp, buffer);
+
+    if (EB_RAW_HEADER_SIZE + len > EB_XDP_FRAME_SIZE || eb_xdp_ring_free(&xdp->tx) == 0) {
+        // Frame cannot be sent, give it back
+        xdp->tx_free[xdp->tx_free_count++] = address;
+        errno = EB_RAW_HEADER_SIZE + len > EB_XDP_FRAME_SIZE ? EMSGSIZE : EBUSY;
+        return -1;
+    }
+
+    // Patch the lengths and the checksum and put the frame on the TX ring
+    eb_frame_finish(xdp->umem + address, len);
+    struct xdp_desc *desc = &((struct xdp_desc *) xdp->tx.ring)[xdp->tx.cached & (EB_XDP_RING_SIZE - 1)];
+    desc->addr = address;
+    desc->len = EB_RAW_HEADER_SIZE + len;
+    desc->options = 0;
+    xdp->tx.cached++;
+    eb_xdp_ring_submit(&xdp->tx);
+
+    // Wake up the kernel to transmit the frame (only when required)
+    if (!xdp->need_wakeup || (__atomic_load_n(xdp->tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)) {
+        if (sendto(xdp->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 && errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+            return -1;
+        }
+    }
+    return len;
+}
+
+
+int eb_xdp_sendv(struct eb_xdp *xdp, const struct iovec *iov, int iovcnt) {
+    uint8_t *buffer = eb_xdp_alloc_tx(xdp);
+    if (!buffer) {
+        return -1;
+    }
+    size_t len = 0;
+    for (int i=0; i<iovcnt; i++) {
+        if (EB_RAW_HEADER_SIZE + len + iov[i].iov_len > EB_XDP_FRAME_SIZE) {
+            xdp->tx_free[xdp->tx_free_count++] = eb_xdp_frame_address(xdp, buffer);
+            errno = EMSGSIZE;
+            return -1;
+        }
+        memcpy(buffer + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    return eb_xdp_submit_tx(xdp, buffer, len);
+}
+
+
+int eb_xdp_recv_in_place(struct eb_xdp *xdp, uint8_t **buffer, int timeout_ms) {
+    while (1) {
+        // Wait for a frame to arrive
+        if (eb_xdp_ring_available(&xdp->rx) == 0) {
+            struct pollfd pfd = {.fd = xdp->fd, .events = POLLIN};
+            int r = poll(&pfd, 1, timeout_ms);
+            if (r <= 0) {
+                errno = r == 0 ? EAGAIN : errno;
+                return -1;
+            }
+            continue;
+        }
+        struct xdp_desc desc = ((struct xdp_desc *) xdp->rx.ring)[xdp->rx.cached & (EB_XDP_RING_SIZE - 1)];
+        xdp->rx.cached++;
+        eb_xdp_ring_release(&xdp->rx);
+
+        // Check the frame is from the board (the program should have passed all others
+        // to the kernel)
+        const uint8_t *payload;
+        int count = eb_frame_parse(xdp->umem + desc.addr, desc.len, xdp->board_ip, xdp->port, &payload);
+        if (count >= 0) {
+            *buffer = (uint8_t *) payload;
+            return count;
+        }
+        eb_xdp_fill(xdp, eb_xdp_frame_address(xdp, xdp->umem + desc.addr));
+    }
+}
+
+
+void eb_xdp_release_rx(struct eb_xdp *xdp, uint8_t *buffer) {
+    eb_xdp_fill(xdp, eb_xdp_frame_address(xdp, buffer));
+}
+
+
+int eb_xdp_recvv(struct eb_xdp *xdp, const struct iovec *iov, int iovcnt, int timeout_ms) {
+    uint8_t *buffer;
+    int count = eb_xdp_recv_in_place(xdp, &buffer, timeout_ms);
+    if (count < 0) {
+        return count;
+    }
+    count = eb_frame_scatter(buffer, count, iov, iovcnt);
+    eb_xdp_release_rx(xdp, buffer);
+    return count;
+}
+
+
+void eb_xdp_close(struct eb_xdp *xdp) {
+    if (!xdp)
+        return;
+    if (xdp->rule_location >= 0) {
+        struct ethtool_rxnfc rule;
+        memset(&rule, 0, sizeof(rule));
+        rule.cmd = ETHTOOL_SRXCLSRLDEL;
+        rule.fs.location = xdp->rule_location;
+        eb_xdp_ethtool(xdp->ifname, &rule);
+    }
+    if (xdp->link_fd >= 0)
+        close(xdp->link_fd);
+    if (xdp->prog_fd >= 0)
+        close(xdp->prog_fd);
+    if (xdp->map_fd >= 0)
+        close(xdp->map_fd);
+    struct eb_xdp_ring *rings[] = {&xdp->fill, &xdp->comp, &xdp->rx, &xdp->tx};
+    for (size_t i=0; i<4; i++) {
+        if (rings[i]->map)
+            munmap(rings[i]->map, rings[i]->map_size);
+    }
+    if (xdp->fd >= 0)
+        close(xdp->fd);
+    if (xdp->umem)
+        munmap(xdp->umem, xdp->umem_size);
+    free(xdp);
+}
+
+#else
+
+// The kernel headers do not support AF_XDP, the transport is not available
+struct eb_xdp *eb_xdp_open(const char *ifname, const char *addr, const char *port, uint64_t mac_address) {
+    fprintf(stderr, "etherbone: the AF_XDP transport is not supported by this build\n");
+    return NULL;
+}
+int eb_xdp_is_zero_copy(struct eb_xdp *xdp) { return 0; }
+int eb_xdp_get_fd(struct eb_xdp *xdp) { return -1; }
+uint8_t *eb_xdp_alloc_tx(struct eb_xdp *xdp) { errno = ENOTSUP; return NULL; }
+int eb_xdp_submit_tx(struct eb_xdp *xdp, uint8_t *buffer, size_t len) { errno = ENOTSUP; return -1; }
+int eb_xdp_sendv(struct eb_xdp *xdp, const struct iovec *iov, int iovcnt) { errno = ENOTSUP; return -1; }
+int eb_xdp_recv_in_place(struct eb_xdp *xdp, uint8_t **buffer, int timeout_ms) { errno = ENOTSUP; return -1; }
+void eb_xdp_release_rx(struct eb_xdp *xdp, uint8_t *buffer) {}
+int eb_xdp_recvv(struct eb_xdp *xdp, const struct iovec *iov, int iovcnt, int timeout_ms) { errno = ENOTSUP; return -1; }
+void eb_xdp_close(struct eb_xdp *xdp) {}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __ETHERBONE_XDP_H__
+#define __ETHERBONE_XDP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+
+The AF_XDP transport exchanges the Ethernet frames with the board through a UMEM,
+a memory region shared between the driver and the network card. The frames from the
+board are redirected to the socket by a small XDP program, all other traffic on the
+interface is passed to the kernel as usual.
+
+When the network card supports it, the frames are transferred directly from and to
+the UMEM (zero-copy), otherwise the kernel copies the frames (copy mode). On the hot
+path the only system call is the wake-up of the kernel for transmission.
+
+The UMEM is divided in frames of EB_XDP_FRAME_SIZE bytes. The first half of the
+frames is used for receiving (fill ring), the other half for transmitting. Just like
+the raw transport, each frame starts with the Ethernet, IP and UDP headers
+(EB_RAW_HEADER_SIZE bytes), followed by the Etherbone packet. Buffers handed out by
+this transport point to the Etherbone packet in the frame, so the data can be
+written and read in place.
+
+For the zero-copy path:
+- `eb_xdp_alloc_tx` returns a free frame to write the Etherbone packet in;
+- `eb_xdp_submit_tx` sends that frame;
+- `eb_xdp_recv_in_place` returns a received frame, which must be given back to the
+  kernel with `eb_xdp_release_rx` when the data has been processed.
+
+The transport is only available when the kernel headers support AF_XDP.
+*/
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/if_xdp.h>) && __has_include(<linux/bpf.h>)
+#define EB_WITH_XDP 1
+#endif
+#endif
+
+#define EB_XDP_FRAME_SIZE 2048
+#define EB_XDP_FRAME_COUNT 64
+#define EB_XDP_RING_SIZE 32
+
+struct eb_xdp;
+
+struct eb_xdp *eb_xdp_open(const char *ifname, const char *addr, const char *port, uint64_t mac_address);
+int eb_xdp_is_zero_copy(struct eb_xdp *xdp);
+int eb_xdp_get_fd(struct eb_xdp *xdp);
+uint8_t *eb_xdp_alloc_tx(struct eb_xdp *xdp);
+int eb_xdp_submit_tx(struct eb_xdp *xdp, uint8_t *buffer, size_t len);
+int eb_xdp_sendv(struct eb_xdp *xdp, const struct iovec *iov, int iovcnt);
+int eb_xdp_recv_in_place(struct eb_xdp *xdp, uint8_t **buffer, int timeout_ms);
+void eb_xdp_release_rx(struct eb_xdp *xdp, uint8_t *buffer);
+int eb_xdp_recvv(struct eb_xdp *xdp, const struct iovec *iov, int iovcnt, int timeout_ms);
+void eb_xdp_close(struct eb_xdp *xdp);
+
+#ifdef __cplusplus
+};
+#endif /* __cplusplus */
+
+#endif /* __ETHERBONE_XDP_H__ */
@@ -182,65 +182,67 @@ int litexcnc_gpio_init(litexcnc_t *litexcnc, cJSON *config) {
 }
 
 
-uint8_t litexcnc_gpio_prepare_write(litexcnc_t *litexcnc, uint8_t **data) {
+uint8_t litexcnc_gpio_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period) {
 
     if (litexcnc->gpio.num_output_pins == 0) {
         return 0;
     }
 
-    // Process all the bytes
-    static uint8_t mask;
-    mask = 0x80;
-    for (size_t i=LITEXCNC_BOARD_GPIO_DATA_WRITE_SIZE(litexcnc)*8; i>0; i--) {
-        // The counter i can have a value outside the range of possible pins. We only
-        // should add data from existing pins
-        if (i <= litexcnc->gpio.num_output_pins) {
-            *(*data) |= (*(litexcnc->gpio.output_pins[i-1].hal.pin.out) ^ litexcnc->gpio.output_pins[i-1].hal.param.invert_output)?mask:0;
-        }
-        // Modify the mask for the next. When the mask is zero (happens in case of a 
-        // roll-over), we should proceed to the next byte and reset the mask.
-        mask >>= 1;
-        if (!mask) {
-            mask = 0x80;  // Reset the mask
-            (*data)++; // Proceed the buffer to the next element
+    // Process the pins a word at a time (see `litexcnc_flag_write`)
+    for (size_t word=0; word<litexcnc_flag_words(litexcnc->gpio.num_output_pins); word++) {
+        litexcnc_gpio_output_pin_t *pins = &litexcnc->gpio.output_pins[litexcnc_flag_first(litexcnc->gpio.num_output_pins, word)];
+        size_t count = litexcnc_flag_count(litexcnc->gpio.num_output_pins, word);
+        uint32_t flags = 0;
+        for (size_t i=0; i<count; i++) {
+            flags |= (uint32_t) (*(pins[i].hal.pin.out) ^ pins[i].hal.param.invert_output) << i;
         }
+        litexcnc_flag_write(data, flags);
     }
 
     return 0;
 }
 
 
-uint8_t litexcnc_gpio_process_read(litexcnc_t *litexcnc, uint8_t** data) {
+uint8_t litexcnc_gpio_process_read(litexcnc_t *litexcnc, uint8_t** data, long period) {
 
     if (litexcnc->gpio.num_input_pins == 0) {
         return 0;
     }
 
-    // Process all the bytes
-    static uint8_t mask;
-    mask = 0x80;
-    for (size_t i=LITEXCNC_BOARD_GPIO_DATA_READ_SIZE(litexcnc)*8; i>0; i--) {
-        // The counter i can have a value outside the range of possible pins. We only
-        // should add data to existing pins
-        if (i <= litexcnc->gpio.num_input_pins) {
-            if (*(*data) & mask) {
-                // GPIO active
-                *(litexcnc->gpio.input_pins[i-1].hal.pin.in) = 1;
-                *(litexcnc->gpio.input_pins[i-1].hal.pin.in_not) = 0;
-            } else {
-                // GPIO inactive
-                *(litexcnc->gpio.input_pins[i-1].hal.pin.in) = 0;
-                *(litexcnc->gpio.input_pins[i-1].hal.pin.in_not) = 1;
-            }
-        }
-        // Modify the mask for the next. When the mask is zero (happens in case of a 
-        // roll-over), we should proceed to the next byte and reset the mask.
-        mask >>= 1;
-        if (!mask) {
-            mask = 0x80;  // Reset the mask
-            (*data)++; // Proceed the buffer to the next element
+    // Process the pins a word at a time (see `litexcnc_flag_read`)
+    for (size_t word=0; word<litexcnc_flag_words(litexcnc->gpio.num_input_pins); word++) {
+        litexcnc_gpio_input_pin_t *pins = &litexcnc->gpio.input_pins[litexcnc_flag_first(litexcnc->gpio.num_input_pins, word)];
+        size_t count = litexcnc_flag_count(litexcnc->gpio.num_input_pins, word);
+        uint32_t flags = litexcnc_flag_read(data);
+        for (size_t i=0; i<count; i++) {
+            hal_bit_t value = (flags >> i) & 1;
+            *(pins[i].hal.pin.in) = value;
+            *(pins[i].hal.pin.in_not) = !value;
         }
     }
 
     return 0;
 }
+
+
+static size_t litexcnc_gpio_write_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_BOARD_GPIO_DATA_WRITE_SIZE(litexcnc);
+}
+
+
+static size_t litexcnc_gpio_read_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_BOARD_GPIO_DATA_READ_SIZE(litexcnc);
+}
+
+
+// Description of the module for the LitexCNC driver (see `litexcnc_module_t`)
+const litexcnc_module_t litexcnc_gpio_module = {
+    .name = "GPIO",
+    .init = litexcnc_gpio_init,
+    .prepare_write = litexcnc_gpio_prepare_write,
+    .write_size = litexcnc_gpio_write_size,
+    .write_slow = true,
+    .process_read = litexcnc_gpio_process_read,
+    .read_size = litexcnc_gpio_read_size,
+    .slow_rate = true,
+};
@@ -71,7 +71,8 @@ typedef struct {
 // Functions for creating, reading and writing GPIO pins
 int litexcnc_gpio_init(litexcnc_t *litexcnc, cJSON *config);
 uint8_t litexcnc_gpio_config(litexcnc_t *litexcnc, uint8_t **data, long period);
-uint8_t litexcnc_gpio_prepare_write(litexcnc_t *litexcnc, uint8_t **data);
-uint8_t litexcnc_gpio_process_read(litexcnc_t *litexcnc, uint8_t** data);
+uint8_t litexcnc_gpio_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period);
+uint8_t litexcnc_gpio_process_read(litexcnc_t *litexcnc, uint8_t** data, long period);
+extern const litexcnc_module_t litexcnc_gpio_module;
 
 #endif
\ No newline at end of file
@@ -1116,6 +1116,9 @@ def build_rt(tempdir, filename, mode, origfilename):
     print("EXTRA_CFLAGS += -I%s" % os.path.abspath(os.path.dirname(origfilename)), file=f)
     print("EXTRA_CFLAGS += -I%s" % os.path.abspath('.'), file=f)
     print("EXTRA_CFLAGS += -Wall", file=f)
+    # Allow the loops over the instances of the modules to be vectorised. The code does
+    # not rely on floating-point exceptions.
+    print("EXTRA_CFLAGS += -ftree-vectorize -fvect-cost-model=dynamic -fno-trapping-math", file=f)
     # print("JSON_C_DIR=/usr/lib/x86_64-linux-gnu/", file=f)
     # print("EXTRA_CFLAGS += -I/usr/include/json-c", file=f)
     f.close()
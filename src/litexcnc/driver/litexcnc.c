@@ -37,6 +37,7 @@
 MODULE_INFO(linuxcnc, "component:litexcnc:Board driver for FPGA boards supported by litex.");
 MODULE_INFO(linuxcnc, "funct:read:1:Read all registers.");
 MODULE_INFO(linuxcnc, "funct:write:1:Write all registers, and pet the watchdog to keep it from biting.");
+MODULE_INFO(linuxcnc, "funct:communicate:1:Write all registers and read them back in a single transaction.");
 MODULE_INFO(linuxcnc, "author:Peter van Tol petertgvantolATgmailDOTcom");
 MODULE_INFO(linuxcnc, "license:GPL");
 MODULE_LICENSE("GPL");
@@ -49,12 +50,130 @@ struct rtapi_list_head litexcnc_list;
 // This keeps track of the component id. Required for setup and tear down.
 static int comp_id;
 
-static void litexcnc_config(void* void_litexcnc, long period) {
+// The modules of the FPGA, in the order in which they are set up
+static const litexcnc_module_t *litexcnc_modules[] = {
+    &litexcnc_watchdog_module,
+    &litexcnc_wallclock_module,
+    &litexcnc_gpio_module,
+    &litexcnc_pwm_module,
+    &litexcnc_stepgen_module,
+    &litexcnc_encoder_module,
+};
+// The order in which the data of the modules is packed in the configuration, write and
+// read blocks. This order must be the same as the order of the registers of the FPGA
+// (see `mmio.py`). In the write block the data which changes only occasionally comes
+// first (see `write_slow_size`). The modules which may run at a low rate come first in
+// the write block and last in the read block (see `litexcnc_slow_rate_t`).
+static const litexcnc_module_t *litexcnc_config_order[] = {
+    &litexcnc_stepgen_module,
+};
+static const litexcnc_module_t *litexcnc_write_order[] = {
+    &litexcnc_gpio_module,
+    &litexcnc_pwm_module,
+    &litexcnc_encoder_module,
+    &litexcnc_watchdog_module,
+    &litexcnc_stepgen_module,
+};
+static const litexcnc_module_t *litexcnc_read_order[] = {
+    &litexcnc_watchdog_module,
+    &litexcnc_wallclock_module,
+    &litexcnc_stepgen_module,
+    &litexcnc_encoder_module,
+    &litexcnc_gpio_module,
+};
+#define LITEXCNC_ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+
+
+static size_t litexcnc_config_size(litexcnc_t *litexcnc) {
+    size_t size = sizeof(litexcnc_config_header_t);
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_config_order); i++) {
+        size += litexcnc_config_order[i]->config_size(litexcnc);
+    }
+    return size;
+}
+
+
+static size_t litexcnc_write_size(litexcnc_t *litexcnc) {
+    size_t size = 0;
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_write_order); i++) {
+        size += litexcnc_write_order[i]->write_size(litexcnc);
+    }
+    return size;
+}
+
+
+static size_t litexcnc_write_slow_size(litexcnc_t *litexcnc) {
+    // The size of the data of the leading modules of which the data changes only
+    // occasionally
+    size_t size = 0;
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_write_order) && litexcnc_write_order[i]->write_slow; i++) {
+        size += litexcnc_write_order[i]->write_size(litexcnc);
+    }
+    return size;
+}
+
+
+static size_t litexcnc_read_size(litexcnc_t *litexcnc) {
+    size_t size = 0;
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_read_order); i++) {
+        size += litexcnc_read_order[i]->read_size(litexcnc);
+    }
+    return size;
+}
+
+
+static void litexcnc_module_list_add(litexcnc_module_list_t *list, const litexcnc_module_t *module) {
+    list->modules[list->count++] = module;
+}
+
+
+static void litexcnc_setup_modules(litexcnc_t *litexcnc) {
+    // Only the modules which exchange data with this board are called each period. The
+    // size of the data of the modules running at a low rate is determined as well.
+    memset(&litexcnc->modules, 0, sizeof(litexcnc->modules));
+    litexcnc->slow_rate.write_size = 0;
+    litexcnc->slow_rate.read_size = 0;
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_write_order); i++) {
+        const litexcnc_module_t *module = litexcnc_write_order[i];
+        size_t size = module->write_size(litexcnc);
+        if (size == 0) {
+            continue;
+        }
+        litexcnc_module_list_add(&litexcnc->modules.write, module);
+        if (module->slow_rate) {
+            litexcnc_module_list_add(&litexcnc->modules.write_slow, module);
+            litexcnc->slow_rate.write_size += size;
+        } else {
+            litexcnc_module_list_add(&litexcnc->modules.write_fast, module);
+        }
+    }
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_read_order); i++) {
+        const litexcnc_module_t *module = litexcnc_read_order[i];
+        size_t size = module->read_size(litexcnc);
+        if (size == 0) {
+            continue;
+        }
+        litexcnc_module_list_add(&litexcnc->modules.read, module);
+        if (module->slow_rate) {
+            litexcnc_module_list_add(&litexcnc->modules.read_slow, module);
+            litexcnc->slow_rate.read_size += size;
+        } else {
+            litexcnc_module_list_add(&litexcnc->modules.read_fast, module);
+        }
+    }
+}
+
+static int litexcnc_config(void* void_litexcnc, long period) {
     litexcnc_t *litexcnc = void_litexcnc;
 
     // Clear buffer
-    uint8_t *config_buffer = rtapi_kmalloc(LITEXCNC_CONFIG_HEADER_SIZE, RTAPI_GFP_KERNEL);
-    memset(config_buffer, 0, LITEXCNC_CONFIG_HEADER_SIZE);
+    size_t config_size = litexcnc_config_size(litexcnc);
+    uint8_t *config_buffer = rtapi_kmalloc(config_size, RTAPI_GFP_KERNEL);
+    if (config_buffer == NULL) {
+        LITEXCNC_ERR("Out of memory while configuring the FPGA\n", litexcnc->fpga->name);
+        return -ENOMEM;
+    }
+    memset(config_buffer, 0, config_size);
     
     // Configure all the functions
     uint8_t* pointer = config_buffer;
@@ -66,20 +185,231 @@ static void litexcnc_config(void* void_litexcnc, long period) {
     pointer += sizeof(litexcnc_config_header_t);
 
     // Configure all the functions
-    // litexcnc_watchdog_config(litexcnc, &pointer, period);
-    // litexcnc_wallclock_config(litexcnc, &pointer, period);
-    // litexcnc_gpio_config(litexcnc, &pointer, period);
-    // litexcnc_pwm_config(litexcnc, &pointer, period);
-    litexcnc_stepgen_config(litexcnc, &pointer, period);
-    // litexcnc_encoder_config(litexcnc, &pointer, period);
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_config_order); i++) {
+        litexcnc_config_order[i]->config(litexcnc, &pointer, period);
+    }
     
     // Write the data to the FPGA
-    litexcnc->fpga->write_config(litexcnc->fpga, config_buffer, LITEXCNC_CONFIG_HEADER_SIZE);
+    int r = litexcnc->fpga->write_config(litexcnc->fpga, config_buffer, config_size);
+    rtapi_kfree(config_buffer);
+    if (r < 0) {
+        LITEXCNC_ERR("Could not write the configuration to the FPGA\n", litexcnc->fpga->name);
+    }
+    return r;
 }
 
 
-static void litexcnc_read(void* void_litexcnc, long period) {
-    litexcnc_t *litexcnc = void_litexcnc;
+static int litexcnc_verify(litexcnc_t *litexcnc) {
+    // Verify the configuration of the FPGA, does it work with this version of LitexCNC?
+    int r = litexcnc->fpga->verify_config(litexcnc->fpga);
+    if (r == 0) {
+        // Check version of firmware of driver and firmware
+        if (((litexcnc->fpga->version >> 16) & 0xff) != LITEXCNC_VERSION_MAJOR || ((litexcnc->fpga->version >> 8) & 0xff) != LITEXCNC_VERSION_MINOR )  {
+            // Incompatible version
+            LITEXCNC_ERR_NO_DEVICE(
+                "Version of firmware (%u.%u.%u) is incompatible with the version of the driver (%u.%u.%u) \n",
+                (litexcnc->fpga->version >> 16) & 0xff, (litexcnc->fpga->version >> 8) & 0xff, (litexcnc->fpga->version) & 0xff, 
+                LITEXCNC_VERSION_MAJOR, LITEXCNC_VERSION_MINOR, LITEXCNC_VERSION_PATCH);
+            r = -1;
+        } else if ((litexcnc->fpga->version & 0xff) != LITEXCNC_VERSION_PATCH) {
+            // Warn that patch version is different
+            LITEXCNC_PRINT_NO_DEVICE(
+                "INFO: Version of firmware (%u.%u.%u) is different with the version of the driver (%u.%u.%u). Communication is still possible, although one of these could use an update for the best experience. \n",
+                (litexcnc->fpga->version >> 16) & 0xff, (litexcnc->fpga->version >> 8) & 0xff, (litexcnc->fpga->version) & 0xff, 
+                LITEXCNC_VERSION_MAJOR, LITEXCNC_VERSION_MINOR, LITEXCNC_VERSION_PATCH);
+        }
+        // Check fingerprint
+        if (litexcnc->config_fingerprint != litexcnc->fpga->fingerprint) {
+            LITEXCNC_ERR_NO_DEVICE(
+                "Fingerprint incorrect (driver: %08d, FPGA: %08d)\n", 
+                litexcnc->config_fingerprint, 
+                litexcnc->fpga->fingerprint);
+            r = -1;
+        }
+    }
+    return r;
+}
+
+
+static uint32_t litexcnc_layout_hash(litexcnc_t *litexcnc) {
+    /*
+     * Calculates the hash of the layout of the data exchanged with the FPGA: the CRC of
+     * the sizes of the data of each module (as big-endian 32-bit integers), in the order
+     * in which the data is packed. The firmware calculates the same hash from the sizes
+     * of its registers (see `mmio.py`), so a difference in the order or size of the data
+     * is detected before any data is exchanged.
+     */
+    uint32_t sizes[1 + 3 * LITEXCNC_MAX_MODULES];
+    size_t count = 0;
+    sizes[count++] = htobe32(sizeof(litexcnc_config_header_t));
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_config_order); i++) {
+        sizes[count++] = htobe32(litexcnc_config_order[i]->config_size(litexcnc));
+    }
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_write_order); i++) {
+        sizes[count++] = htobe32(litexcnc_write_order[i]->write_size(litexcnc));
+    }
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_read_order); i++) {
+        sizes[count++] = htobe32(litexcnc_read_order[i]->read_size(litexcnc));
+    }
+    return crc32((unsigned char *) sizes, count * sizeof(sizes[0]), 0);
+}
+
+
+static uint64_t litexcnc_time_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+static void litexcnc_link_failed(litexcnc_t *litexcnc, long period) {
+    // Counts the consecutive periods in which the communication failed. When the limit
+    // is reached, the link is lost and no data is written until it has been recovered.
+    litexcnc->link.failed_cycles++;
+    if (!litexcnc->link.hal->param.loss_cycles || litexcnc->link.failed_cycles < litexcnc->link.hal->param.loss_cycles) {
+        return;
+    }
+    LITEXCNC_ERR("Link with FPGA lost after %u failed periods, outputs are held\n", litexcnc->fpga->name, litexcnc->link.failed_cycles);
+    litexcnc->link.state = LITEXCNC_LINK_LOST;
+    litexcnc->link.hold_cycles = 0;
+    litexcnc->link.lost_time = litexcnc_time_ns() - (uint64_t) litexcnc->link.failed_cycles * period;
+    *litexcnc->link.hal->pin.up = false;
+}
+
+
+static void litexcnc_link_recover(litexcnc_t *litexcnc, long period) {
+    /*
+     * Performs a single step of the recovery of the link with the FPGA (see
+     * `litexcnc_link_state_t`). The low-level driver waits at most a fraction of the
+     * period for the FPGA, so the recovery does not disturb the timing of the thread.
+     * When a step fails, the outputs are held again before the next attempt, so an
+     * FPGA which does not respond is not flooded with requests.
+     */
+    litexcnc_fpga_t *fpga = litexcnc->fpga;
+    fpga->period = period;
+    fpga->timeout = LITEXCNC_LINK_STEP_BUDGET * period;
+
+    switch (litexcnc->link.state) {
+    case LITEXCNC_LINK_LOST:
+        // Hold the outputs, so the watchdog on the FPGA has disabled them before the
+        // FPGA is reset
+        litexcnc->link.hold_cycles++;
+        if (litexcnc->link.hold_cycles >= litexcnc->link.hal->param.hold_cycles) {
+            litexcnc->link.state = LITEXCNC_LINK_VERIFY;
+        }
+        break;
+    case LITEXCNC_LINK_VERIFY:
+        litexcnc->link.state = litexcnc_verify(litexcnc) == 0 ? LITEXCNC_LINK_RESET : LITEXCNC_LINK_LOST;
+        litexcnc->link.hold_cycles = 0;
+        break;
+    case LITEXCNC_LINK_RESET:
+        litexcnc->link.state = fpga->reset(fpga) == 0 ? LITEXCNC_LINK_CONFIG : LITEXCNC_LINK_LOST;
+        break;
+    case LITEXCNC_LINK_CONFIG:
+        // The configuration is written as in the first period, after which the data is
+        // exchanged again from the next period on. The wall clock is moved forward by
+        // the time the link was lost, minus a period to prevent it from overshooting.
+        // When the configuration could not be written, the FPGA is reset again.
+        if (litexcnc_config(litexcnc, period) < 0) {
+            litexcnc->link.state = LITEXCNC_LINK_LOST;
+            break;
+        }
+        litexcnc_wallclock_realign(litexcnc, litexcnc_time_ns() - litexcnc->link.lost_time - period);
+        litexcnc_stepgen_realign(litexcnc);
+        litexcnc->link.state = LITEXCNC_LINK_UP;
+        litexcnc->link.failed_cycles = 0;
+        *litexcnc->link.hal->pin.up = true;
+        (*litexcnc->link.hal->pin.recoveries)++;
+        LITEXCNC_PRINT("Link with FPGA recovered\n", fpga->name);
+        break;
+    default:
+        break;
+    }
+    fpga->timeout = 0;
+}
+
+
+static void litexcnc_handover_put(litexcnc_handover_t *handover, const uint8_t *data, size_t size) {
+    uint32_t sequence = handover->sequence;
+    __atomic_store_n(&handover->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(handover->data, data, size);
+    __atomic_store_n(&handover->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+
+static bool litexcnc_handover_get(litexcnc_handover_t *handover, uint8_t *data, size_t size, uint32_t *seen) {
+    // Copies the data when it has changed since the last copy. Returns false when the
+    // data has not changed or the copy has been interrupted, the copy must then not be
+    // used.
+    uint32_t sequence = __atomic_load_n(&handover->sequence, __ATOMIC_ACQUIRE);
+    if ((sequence & 1) || (sequence == *seen)) {
+        return false;
+    }
+    memcpy(data, handover->data, size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&handover->sequence, __ATOMIC_RELAXED) != sequence) {
+        return false;
+    }
+    *seen = sequence;
+    return true;
+}
+
+
+static void litexcnc_process_read(litexcnc_t *litexcnc, const litexcnc_module_list_t *modules, uint8_t *data, long period) {
+    // Process the read data for the different compenents
+    uint8_t* pointer = data;
+    for (size_t i=0; i<modules->count; i++) {
+        modules->modules[i]->process_read(litexcnc, &pointer, period);
+    }
+}
+
+
+static void litexcnc_prepare_write(litexcnc_t *litexcnc, const litexcnc_module_list_t *modules, uint8_t *data, size_t size, long period) {
+    // Process all functions. The data which changes only occasionally comes first (see
+    // `write_slow_size`), followed by the data which changes each period. The modules
+    // write all their data, so the buffer is not cleared beforehand. Only the part not
+    // written by the modules (if any) is cleared.
+    uint8_t* pointer = data;
+    for (size_t i=0; i<modules->count; i++) {
+        modules->modules[i]->prepare_write(litexcnc, &pointer, period);
+    }
+    if (pointer < data + size) {
+        memset(pointer, 0, data + size - pointer);
+    }
+}
+
+
+static void litexcnc_prepare_write_all(litexcnc_t *litexcnc, long period) {
+    litexcnc_prepare_write(
+        litexcnc, 
+        &litexcnc->modules.write,
+        litexcnc->fpga->write_buffer + litexcnc->fpga->write_header_size, 
+        litexcnc->fpga->write_buffer_size - litexcnc->fpga->write_header_size - litexcnc->fpga->write_footer_size,
+        period);
+}
+
+
+static void litexcnc_prepare_write_fast(litexcnc_t *litexcnc, long period) {
+    // The data of the slow thread is copied from the hand-over when it has changed,
+    // otherwise the last complete copy is used
+    uint8_t *data = litexcnc->fpga->write_buffer + litexcnc->fpga->write_header_size;
+    size_t slow_size = litexcnc->slow_rate.write_size;
+    if (litexcnc_handover_get(&litexcnc->slow_rate.write, data, slow_size, &litexcnc->slow_rate.write_seen)) {
+        memcpy(litexcnc->slow_rate.write_copy, data, slow_size);
+    } else {
+        memcpy(data, litexcnc->slow_rate.write_copy, slow_size);
+    }
+    litexcnc_prepare_write(
+        litexcnc, 
+        &litexcnc->modules.write_fast,
+        data + slow_size, 
+        litexcnc->fpga->write_buffer_size - litexcnc->fpga->write_header_size - litexcnc->fpga->write_footer_size - slow_size,
+        period);
+}
+
+
+static void litexcnc_read_data(litexcnc_t *litexcnc, long period, bool fast) {
 
     // The first loop no data is read, as it is used for sending the configuration to the 
     // FPGA. The configuration is written in the `litexcnc_write` function. 
@@ -88,30 +418,58 @@ static void litexcnc_read(void* void_litexcnc, long period) {
         return;
     }
 
-    // Clear buffer (except for the header)
-    memset(
-        litexcnc->fpga->read_buffer + litexcnc->fpga->read_header_size, 
-        0, 
-        litexcnc->fpga->read_buffer_size
-    );
-    
-    // Read the state from the FPGA
-    litexcnc->fpga->read(litexcnc->fpga);
+    // While the link with the FPGA is lost, the previous state is kept. The link is 
+    // recovered in the `litexcnc_write` function.
+    if (litexcnc->link.state != LITEXCNC_LINK_UP) {
+        return;
+    }
 
-    // TODO: don't process the read data in case the read has failed.
+    // Read the state from the FPGA. When this fails (for example when no response or
+    // only responses from earlier periods are received), the previous state is kept.
+    // The data is only processed when it has been received completely, so the buffer
+    // is not cleared beforehand.
+    // The data of the modules running at a low rate is only read when asked for.
+    litexcnc->fpga->period = period;
+    litexcnc->fpga->slow_rate.requested = !fast || __atomic_load_n(&litexcnc->slow_rate.read_requested, __ATOMIC_ACQUIRE);
+    int r = litexcnc->fpga->read(litexcnc->fpga);
+    if (r < 0) {
+        *litexcnc->fpga->io_error = true;
+        litexcnc_link_failed(litexcnc, period);
+    }
+    if (r != 0) {
+        return;
+    }
+    litexcnc->link.failed_cycles = 0;
+
+    // The data written in this period is based on the data read, which might be
+    // requested in the previous period
+    litexcnc->write_lag = litexcnc->fpga->read_lag;
+    uint8_t *data = litexcnc->fpga->read_buffer + litexcnc->fpga->read_header_size;
+    if (!fast) {
+        litexcnc_process_read(litexcnc, &litexcnc->modules.read, data, period);
+        return;
+    }
+    litexcnc_process_read(litexcnc, &litexcnc->modules.read_fast, data, period);
+    if (litexcnc->fpga->slow_rate.received) {
+        litexcnc_handover_put(
+            &litexcnc->slow_rate.read, 
+            data + litexcnc->fpga->read_buffer_size - litexcnc->fpga->read_header_size - litexcnc->slow_rate.read_size, 
+            litexcnc->slow_rate.read_size);
+        __atomic_store_n(&litexcnc->slow_rate.read_requested, false, __ATOMIC_RELEASE);
+    }
+}
 
-    // Process the read data for the different compenents
-    uint8_t* pointer = litexcnc->fpga->read_buffer + litexcnc->fpga->read_header_size;
-    litexcnc_watchdog_process_read(litexcnc, &pointer);
-    litexcnc_wallclock_process_read(litexcnc, &pointer);
-    litexcnc_gpio_process_read(litexcnc, &pointer);
-    litexcnc_pwm_process_read(litexcnc, &pointer);
-    litexcnc_stepgen_process_read(litexcnc, &pointer, period);
-    litexcnc_encoder_process_read(litexcnc, &pointer, period);
+
+static void litexcnc_read(void* void_litexcnc, long period) {
+    litexcnc_read_data(void_litexcnc, period, false);
 }
 
-static void litexcnc_write(void *void_litexcnc, long period) {
-    litexcnc_t *litexcnc = void_litexcnc;
+
+static void litexcnc_read_fast(void* void_litexcnc, long period) {
+    litexcnc_read_data(void_litexcnc, period, true);
+}
+
+static void litexcnc_write_data(litexcnc_t *litexcnc, long period, bool fast) {
 
     // Check whether the write has been initialized AND the read and write functions
     // are in the recommended order (first read, then write). In the first loop the
@@ -124,29 +482,111 @@ static void litexcnc_write(void *void_litexcnc, long period) {
             LITEXCNC_WARN("Read and write functions in incorrect order. Recommended order is read first, then write.\n", litexcnc->fpga->name);
         }
         // Configure the FPGA and set flag that the write function has been done once
-        litexcnc_config(void_litexcnc, period);
+        litexcnc_config(litexcnc, period);
         litexcnc->write_loop_has_run = true;
         return;
     }
 
-    // Clear buffer (except for the header)
-    memset(
-        litexcnc->fpga->write_buffer + litexcnc->fpga->write_header_size, 
-        0, 
-        litexcnc->fpga->write_buffer_size
-    );
+    // While the link with the FPGA is lost, no data is written. Instead, a step of the
+    // recovery is performed.
+    if (litexcnc->link.state != LITEXCNC_LINK_UP) {
+        litexcnc_link_recover(litexcnc, period);
+        return;
+    }
 
     // Process all functions
-    uint8_t* pointer = litexcnc->fpga->write_buffer + litexcnc->fpga->write_header_size;
-    litexcnc_watchdog_prepare_write(litexcnc, &pointer, period);
-    litexcnc_wallclock_prepare_write(litexcnc, &pointer);
-    litexcnc_gpio_prepare_write(litexcnc, &pointer);
-    litexcnc_pwm_prepare_write(litexcnc, &pointer);
-    litexcnc_stepgen_prepare_write(litexcnc, &pointer, period);
-    litexcnc_encoder_prepare_write(litexcnc, &pointer, period);
+    if (fast) {
+        litexcnc_prepare_write_fast(litexcnc, period);
+    } else {
+        litexcnc_prepare_write_all(litexcnc, period);
+    }
 
     // Write the data to the FPGA
-    litexcnc->fpga->write(litexcnc->fpga);
+    litexcnc->fpga->period = period;
+    if (litexcnc->fpga->write(litexcnc->fpga) < 0) {
+        *litexcnc->fpga->io_error = true;
+    }
+}
+
+
+static void litexcnc_write(void *void_litexcnc, long period) {
+    litexcnc_write_data(void_litexcnc, period, false);
+}
+
+
+static void litexcnc_write_fast(void *void_litexcnc, long period) {
+    litexcnc_write_data(void_litexcnc, period, true);
+}
+
+
+static void litexcnc_read_slow(void *void_litexcnc, long period) {
+    // Processes the data read by the fast thread since the last call and asks for new
+    // data, which is read with the next read of the fast thread
+    litexcnc_t *litexcnc = void_litexcnc;
+    if (litexcnc_handover_get(&litexcnc->slow_rate.read, litexcnc->slow_rate.read_data, litexcnc->slow_rate.read_size, &litexcnc->slow_rate.read_seen)) {
+        litexcnc_process_read(litexcnc, &litexcnc->modules.read_slow, litexcnc->slow_rate.read_data, period);
+    }
+    __atomic_store_n(&litexcnc->slow_rate.read_requested, true, __ATOMIC_RELEASE);
+}
+
+
+static void litexcnc_write_slow(void *void_litexcnc, long period) {
+    // Hands the data over to the fast thread, which sends it with its next write
+    litexcnc_t *litexcnc = void_litexcnc;
+    litexcnc_prepare_write(litexcnc, &litexcnc->modules.write_slow, litexcnc->slow_rate.write_data, litexcnc->slow_rate.write_size, period);
+    litexcnc_handover_put(&litexcnc->slow_rate.write, litexcnc->slow_rate.write_data, litexcnc->slow_rate.write_size);
+}
+
+
+static void litexcnc_communicate(void *void_litexcnc, long period) {
+    litexcnc_t *litexcnc = void_litexcnc;
+
+    // The first loop is used to configure the FPGA, see `litexcnc_write`. Because the
+    // read and write are combined, both loops are marked as done.
+    if (!litexcnc->write_loop_has_run) {
+        litexcnc_config(void_litexcnc, period);
+        litexcnc->write_loop_has_run = true;
+        litexcnc->read_loop_has_run = true;
+        return;
+    }
+
+    // While the link with the FPGA is lost, a step of the recovery is performed instead
+    if (litexcnc->link.state != LITEXCNC_LINK_UP) {
+        litexcnc_link_recover(litexcnc, period);
+        return;
+    }
+
+    // Process all functions. The data is based on the read in the previous period.
+    litexcnc_prepare_write_all(litexcnc, period);
+
+    // Write the data to the FPGA and read the state back in a single transaction. When
+    // this fails, the previous state is kept.
+    litexcnc->fpga->period = period;
+    int r = litexcnc->fpga->communicate(litexcnc->fpga);
+    if (r < 0) {
+        *litexcnc->fpga->io_error = true;
+        litexcnc_link_failed(litexcnc, period);
+    }
+    if (r != 0) {
+        return;
+    }
+    litexcnc->link.failed_cycles = 0;
+
+    // The data calculated with this read is sent at the start of the next period
+    litexcnc->write_lag = 1;
+    litexcnc_process_read(litexcnc, &litexcnc->modules.read, litexcnc->fpga->read_buffer + litexcnc->fpga->read_header_size, period);
+}
+
+
+EXPORT_SYMBOL_GPL(litexcnc_read_fpga);
+void litexcnc_read_fpga(litexcnc_fpga_t *fpga, long period) {
+    litexcnc_read(fpga->litexcnc, period);
+}
+
+
+EXPORT_SYMBOL_GPL(litexcnc_write_fpga);
+void litexcnc_write_fpga(litexcnc_fpga_t *fpga, long period) {
+    litexcnc_write(fpga->litexcnc, period);
 }
 
 
@@ -217,38 +657,14 @@ int litexcnc_register(litexcnc_fpga_t *fpga, cJSON *config, uint32_t fingerprint
 
     // Store the FPGA on it
     litexcnc->fpga = fpga;
+    fpga->litexcnc = litexcnc;
     
     // Add it to the list
     rtapi_list_add_tail(&litexcnc->list, &litexcnc_list);
 
     // Verify the configuration of the FPGA, does it work with this version of LitexCNC?
-    r = litexcnc->fpga->verify_config(litexcnc->fpga);
-    if (r == 0) {
-        // Check version of firmware of driver and firmware
-        if (((litexcnc->fpga->version >> 16) & 0xff) != LITEXCNC_VERSION_MAJOR || ((litexcnc->fpga->version >> 8) & 0xff) != LITEXCNC_VERSION_MINOR )  {
-            // Incompatible version
-            LITEXCNC_ERR_NO_DEVICE(
-                "Version of firmware (%u.%u.%u) is incompatible with the version of the driver (%u.%u.%u) \n",
-                (litexcnc->fpga->version >> 16) & 0xff, (litexcnc->fpga->version >> 8) & 0xff, (litexcnc->fpga->version) & 0xff, 
-                LITEXCNC_VERSION_MAJOR, LITEXCNC_VERSION_MINOR, LITEXCNC_VERSION_PATCH);
-            r = -1;
-        } else if ((litexcnc->fpga->version & 0xff) != LITEXCNC_VERSION_PATCH) {
-            // Warn that patch version is different
-            LITEXCNC_PRINT_NO_DEVICE(
-                "INFO: Version of firmware (%u.%u.%u) is different with the version of the driver (%u.%u.%u). Communication is still possible, although one of these could use an update for the best experience. \n",
-                (litexcnc->fpga->version >> 16) & 0xff, (litexcnc->fpga->version >> 8) & 0xff, (litexcnc->fpga->version) & 0xff, 
-                LITEXCNC_VERSION_MAJOR, LITEXCNC_VERSION_MINOR, LITEXCNC_VERSION_PATCH);
-        }
-        // Check fingerprint
-        litexcnc->config_fingerprint = fingerprint;
-        if (litexcnc->config_fingerprint != litexcnc->fpga->fingerprint) {
-            LITEXCNC_ERR_NO_DEVICE(
-                "Fingerprint incorrect (driver: %08d, FPGA: %08d)\n", 
-                litexcnc->config_fingerprint, 
-                litexcnc->fpga->fingerprint);
-            r = -1;
-        }
-    }
+    litexcnc->config_fingerprint = fingerprint;
+    r = litexcnc_verify(litexcnc);
     if (r != 0) {
         LITEXCNC_ERR_NO_DEVICE("Validation of config failed.\n");
         goto fail0;
@@ -293,77 +709,77 @@ int litexcnc_register(litexcnc_fpga_t *fpga, cJSON *config, uint32_t fingerprint
         goto fail1;
     } 
     litexcnc->clock_frequency = clock_frequency->valueint;
-    litexcnc->clock_frequency_recip = 1.0f / litexcnc->clock_frequency;
+    litexcnc->clock_frequency_recip = 1.0 / litexcnc->clock_frequency;
+
+    // Store the format of the status of the FPGA (optional, default is the full format)
+    const cJSON *compact_status = NULL;
+    compact_status = cJSON_GetObjectItemCaseSensitive(config, "compact_status");
+    litexcnc->config.compact_status = cJSON_IsTrue(compact_status);
 
     // Initialize modules
     LITEXCNC_PRINT_NO_DEVICE("Setting up modules...\n");
-    LITEXCNC_PRINT_NO_DEVICE(" - Watchdog\n");
-    if (litexcnc_watchdog_init(litexcnc, config) < 0) {
-        LITEXCNC_ERR_NO_DEVICE("Watchdog init failed\n");
-        goto fail0;
-    }
-    LITEXCNC_PRINT_NO_DEVICE(" - Wallclock\n");
-    if (litexcnc_wallclock_init(litexcnc, config) < 0) {
-        LITEXCNC_ERR_NO_DEVICE("Wallclock init failed\n");
-        goto fail0;
-    }
-    LITEXCNC_PRINT_NO_DEVICE(" - GPIO\n");
-    if (litexcnc_gpio_init(litexcnc, config) < 0) {
-        LITEXCNC_ERR_NO_DEVICE("GPIO init failed\n");
-        goto fail0;
-    }
-    LITEXCNC_PRINT_NO_DEVICE(" - PWM\n");
-    if (litexcnc_pwm_init(litexcnc, config) < 0) {
-        LITEXCNC_ERR_NO_DEVICE("PWM init failed\n");
-        goto fail0;
-    }
-    LITEXCNC_PRINT_NO_DEVICE(" - Stepgen\n");
-    if (litexcnc_stepgen_init(litexcnc, config) < 0) {
-        LITEXCNC_ERR_NO_DEVICE("Stepgen init failed\n");
-        goto fail0;
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(litexcnc_modules); i++) {
+        LITEXCNC_PRINT_NO_DEVICE(" - %s\n", litexcnc_modules[i]->name);
+        if (litexcnc_modules[i]->init(litexcnc, config) < 0) {
+            LITEXCNC_ERR_NO_DEVICE("%s init failed\n", litexcnc_modules[i]->name);
+            goto fail0;
+        }
     }
-    LITEXCNC_PRINT_NO_DEVICE(" - Encoder\n");
-    if (litexcnc_encoder_init(litexcnc, config) < 0) {
-        LITEXCNC_ERR_NO_DEVICE("Encoder init failed\n");
-        goto fail0;
+    litexcnc_setup_modules(litexcnc);
+
+    // Check whether the data is laid out the same on the FPGA
+    if (litexcnc->fpga->layout != litexcnc_layout_hash(litexcnc)) {
+        LITEXCNC_ERR_NO_DEVICE(
+            "Layout of the registers incorrect (driver: %08X, FPGA: %08X)\n", 
+            litexcnc_layout_hash(litexcnc), 
+            litexcnc->fpga->layout);
+        r = -1;
+        goto fail1;
     }
 
+    // The size of the configuration, which depends on the number of instances of the modules
+    litexcnc->fpga->config_size = litexcnc_config_size(litexcnc);
+
     // Create the buffers for reading and writing data
     LITEXCNC_PRINT_NO_DEVICE("Creating read and write buffers...\n");
     // - write buffer
-    litexcnc->fpga->write_buffer_size = litexcnc->fpga->write_header_size + LITEXCNC_BOARD_DATA_WRITE_SIZE(litexcnc);
-    LITEXCNC_PRINT_NO_DEVICE(" - Write buffer: %zu bytes)\n", LITEXCNC_BOARD_DATA_WRITE_SIZE(litexcnc));
-    uint8_t *write_buffer = rtapi_kmalloc(litexcnc->fpga->write_buffer_size, RTAPI_GFP_KERNEL);
-    if (litexcnc == NULL) {
+    litexcnc->fpga->write_buffer_size = litexcnc->fpga->write_header_size + litexcnc_write_size(litexcnc) + litexcnc->fpga->write_footer_size;
+    LITEXCNC_PRINT_NO_DEVICE(" - Write buffer: %zu bytes)\n", litexcnc_write_size(litexcnc));
+    uint8_t *write_buffer = litexcnc_alloc_buffer(litexcnc->fpga->write_buffer_size);
+    if (write_buffer == NULL) {
         LITEXCNC_PRINT_NO_DEVICE("out of memory!\n");
         r = -ENOMEM;
         goto fail1;
     }
-    memset(write_buffer, 0, litexcnc->fpga->write_buffer_size);
     litexcnc->fpga->write_buffer = write_buffer;
+    litexcnc->fpga->write_slow_size = litexcnc_write_slow_size(litexcnc);
     // - read buffer
-    LITEXCNC_PRINT_NO_DEVICE(" - Read buffer: %zu bytes)\n", LITEXCNC_BOARD_DATA_READ_SIZE(litexcnc));
-    litexcnc->fpga->read_buffer_size = litexcnc->fpga->read_header_size + LITEXCNC_BOARD_DATA_READ_SIZE(litexcnc);
-    uint8_t *read_buffer = rtapi_kmalloc(litexcnc->fpga->read_buffer_size, RTAPI_GFP_KERNEL);
-    if (litexcnc == NULL) {
+    LITEXCNC_PRINT_NO_DEVICE(" - Read buffer: %zu bytes)\n", litexcnc_read_size(litexcnc));
+    litexcnc->fpga->read_buffer_size = litexcnc->fpga->read_header_size + litexcnc_read_size(litexcnc);
+    uint8_t *read_buffer = litexcnc_alloc_buffer(litexcnc->fpga->read_buffer_size);
+    if (read_buffer == NULL) {
         LITEXCNC_PRINT_NO_DEVICE("out of memory!\n");
         r = -ENOMEM;
         goto fail1;
     }
-    memset(read_buffer, 0, litexcnc->fpga->read_buffer_size);
     litexcnc->fpga->read_buffer = read_buffer;
+    // - buffers for the modules running at a low rate. Unless the fast functions are
+    //   used, all data is read each period.
+    litexcnc->slow_rate.write.data = rtapi_kzalloc(litexcnc->slow_rate.write_size + 1, RTAPI_GFP_KERNEL);
+    litexcnc->slow_rate.read.data  = rtapi_kzalloc(litexcnc->slow_rate.read_size + 1, RTAPI_GFP_KERNEL);
+    litexcnc->slow_rate.write_data = rtapi_kzalloc(litexcnc->slow_rate.write_size + 1, RTAPI_GFP_KERNEL);
+    litexcnc->slow_rate.read_data  = rtapi_kzalloc(litexcnc->slow_rate.read_size + 1, RTAPI_GFP_KERNEL);
+    litexcnc->slow_rate.write_copy = rtapi_kzalloc(litexcnc->slow_rate.write_size + 1, RTAPI_GFP_KERNEL);
+    if (!litexcnc->slow_rate.write.data || !litexcnc->slow_rate.read.data || !litexcnc->slow_rate.write_data || !litexcnc->slow_rate.read_data || !litexcnc->slow_rate.write_copy) {
+        LITEXCNC_PRINT_NO_DEVICE("out of memory!\n");
+        r = -ENOMEM;
+        goto fail1;
+    }
+    litexcnc->fpga->slow_rate.read_size = litexcnc->slow_rate.read_size;
+    litexcnc->fpga->slow_rate.requested = true;
 
     // Export functions
     LITEXCNC_PRINT_NO_DEVICE("Exporting functions...\n");
-    // // - communicate function
-    // char name[HAL_NAME_LEN + 1];
-    // rtapi_snprintf(name, sizeof(name), "%s.communicate", litexcnc->fpga->name);
-    // r = hal_export_funct(name, litexcnc_communicate, litexcnc, 1, 0, litexcnc->fpga->comp_id);
-    // if (r != 0) {
-    //     LITEXCNC_ERR("Error %d exporting `communicate` function %s\n", r, name);
-    //     r = -EINVAL;
-    //     goto fail1;
-    // }
     // - read function
     char name[HAL_NAME_LEN + 1];
     rtapi_snprintf(name, sizeof(name), "%s.read", litexcnc->fpga->name);
@@ -381,6 +797,75 @@ int litexcnc_register(litexcnc_fpga_t *fpga, cJSON *config, uint32_t fingerprint
         r = -EINVAL;
         goto fail1;
     }
+    // - communicate function (only when supported by the low-level driver)
+    if (litexcnc->fpga->communicate != NULL) {
+        rtapi_snprintf(name, sizeof(name), "%s.communicate", litexcnc->fpga->name);
+        r = hal_export_funct(name, litexcnc_communicate, litexcnc, 1, 0, litexcnc->fpga->comp_id);
+        if (r != 0) {
+            LITEXCNC_ERR("error %d exporting communicate function %s\n", litexcnc->fpga->name, r, name);
+            r = -EINVAL;
+            goto fail1;
+        }
+    }
+    // - functions for exchanging the data of the modules at two rates (see
+    //   `litexcnc_slow_rate_t`), to be used instead of the read and write functions
+    const struct {
+        const char *suffix;
+        void (*funct)(void *, long);
+    } multi_rate_functions[] = {
+        {"read-fast",  litexcnc_read_fast},
+        {"write-fast", litexcnc_write_fast},
+        {"read-slow",  litexcnc_read_slow},
+        {"write-slow", litexcnc_write_slow},
+    };
+    for (size_t i=0; i<LITEXCNC_ARRAY_SIZE(multi_rate_functions); i++) {
+        rtapi_snprintf(name, sizeof(name), "%s.%s", litexcnc->fpga->name, multi_rate_functions[i].suffix);
+        r = hal_export_funct(name, multi_rate_functions[i].funct, litexcnc, 1, 0, litexcnc->fpga->comp_id);
+        if (r != 0) {
+            LITEXCNC_ERR("error %d exporting function %s\n", litexcnc->fpga->name, r, name);
+            r = -EINVAL;
+            goto fail1;
+        }
+    }
+
+    // Create a pin which indicates the communication with the FPGA has failed
+    r = hal_pin_bit_newf(HAL_IO, &(litexcnc->fpga->io_error), litexcnc->fpga->comp_id, "%s.io-error", litexcnc->fpga->name);
+    if (r < 0) {
+        LITEXCNC_ERR("error %d adding pin '%s.io-error'\n", litexcnc->fpga->name, r, litexcnc->fpga->name);
+        goto fail1;
+    }
+
+    // Create the pins and parameters for the detection and recovery of the loss of the
+    // link with the FPGA
+    litexcnc->link.hal = (litexcnc_link_hal_t *)hal_malloc(sizeof(litexcnc_link_hal_t));
+    if (litexcnc->link.hal == NULL) {
+        LITEXCNC_ERR("out of memory!\n", litexcnc->fpga->name);
+        r = -ENOMEM;
+        goto fail1;
+    }
+    r = hal_pin_bit_newf(HAL_OUT, &(litexcnc->link.hal->pin.up), litexcnc->fpga->comp_id, "%s.link.up", litexcnc->fpga->name);
+    if (r < 0) {
+        LITEXCNC_ERR("error %d adding pin '%s.link.up'\n", litexcnc->fpga->name, r, litexcnc->fpga->name);
+        goto fail1;
+    }
+    *litexcnc->link.hal->pin.up = true;
+    r = hal_pin_u32_newf(HAL_OUT, &(litexcnc->link.hal->pin.recoveries), litexcnc->fpga->comp_id, "%s.link.recoveries", litexcnc->fpga->name);
+    if (r < 0) {
+        LITEXCNC_ERR("error %d adding pin '%s.link.recoveries'\n", litexcnc->fpga->name, r, litexcnc->fpga->name);
+        goto fail1;
+    }
+    r = hal_param_u32_newf(HAL_RW, &(litexcnc->link.hal->param.loss_cycles), litexcnc->fpga->comp_id, "%s.link.loss-cycles", litexcnc->fpga->name);
+    if (r < 0) {
+        LITEXCNC_ERR("error %d adding param '%s.link.loss-cycles'\n", litexcnc->fpga->name, r, litexcnc->fpga->name);
+        goto fail1;
+    }
+    litexcnc->link.hal->param.loss_cycles = LITEXCNC_LINK_DEFAULT_LOSS_CYCLES;
+    r = hal_param_u32_newf(HAL_RW, &(litexcnc->link.hal->param.hold_cycles), litexcnc->fpga->comp_id, "%s.link.hold-cycles", litexcnc->fpga->name);
+    if (r < 0) {
+        LITEXCNC_ERR("error %d adding param '%s.link.hold-cycles'\n", litexcnc->fpga->name, r, litexcnc->fpga->name);
+        goto fail1;
+    }
+    litexcnc->link.hal->param.hold_cycles = LITEXCNC_LINK_DEFAULT_HOLD_CYCLES;
 
     r = litexcnc->fpga->post_register(litexcnc->fpga);
     if (r != 0) {
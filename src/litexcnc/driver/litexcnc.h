@@ -21,9 +21,43 @@
 // Solve circular dependency by forward referencing the object here
 typedef struct litexcnc_struct litexcnc_t;
 
+#include <stdlib.h>
+
 #include "rtapi.h"
 
 #include "cJSON/cJSON.h"
+
+// Describes a module of the FPGA (GPIO, PWM, stepgen, etc.): the functions to set up
+// the module and to exchange its data with the FPGA. The sizes of the data (in bytes)
+// depend on the configuration of the board. When the module has no registers in a
+// block (configuration, write or read), the functions of that block are left NULL.
+typedef struct {
+    const char *name;
+    int (*init)(litexcnc_t *litexcnc, cJSON *config);
+    // Configuration, written once when the HAL-loop starts
+    uint8_t (*config)(litexcnc_t *litexcnc, uint8_t **data, long period);
+    size_t (*config_size)(litexcnc_t *litexcnc);
+    // Data written to the FPGA each period. The data is packed directly in the buffer
+    // sent to the FPGA, which is not cleared beforehand: all bytes have to be written.
+    uint8_t (*prepare_write)(litexcnc_t *litexcnc, uint8_t **data, long period);
+    size_t (*write_size)(litexcnc_t *litexcnc);
+    // The data written changes only occasionally (see `write_slow_size`)
+    bool write_slow;
+    // Data read from the FPGA each period
+    uint8_t (*process_read)(litexcnc_t *litexcnc, uint8_t **data, long period);
+    size_t (*read_size)(litexcnc_t *litexcnc);
+    // The data can be exchanged at a low rate (see `litexcnc_slow_rate_t`)
+    bool slow_rate;
+} litexcnc_module_t;
+
+// The maximum number of modules
+#define LITEXCNC_MAX_MODULES 16
+
+typedef struct {
+    const litexcnc_module_t *modules[LITEXCNC_MAX_MODULES];
+    size_t count;
+} litexcnc_module_list_t;
+
 #include "gpio.h"
 #include "pwm.h"
 #include "stepgen.h"
@@ -33,7 +67,7 @@ typedef struct litexcnc_struct litexcnc_t;
 
 #define LITEXCNC_NAME    "litexcnc"
 #define LITEXCNC_VERSION_MAJOR 1
-#define LITEXCNC_VERSION_MINOR 1
+#define LITEXCNC_VERSION_MINOR 8
 #define LITEXCNC_VERSION_PATCH 0
 
 
@@ -53,20 +87,13 @@ typedef struct litexcnc_struct litexcnc_t;
 #define LITEXCNC_INFO(fmt, device, args...)     rtapi_print_msg(RTAPI_MSG_INFO, LITEXCNC_NAME "/%s: " fmt, device, ## args)
 #define LITEXCNC_DBG(fmt, device, args...)      rtapi_print_msg(RTAPI_MSG_DBG,  LITEXCNC_NAME "/%s: " fmt, device, ## args)
 
-// ------------------------------------
-// Definitions of data size
-// ------------------------------------
-// Basically these are the summations of all the data sizes from the
-// sub-modules
-#define LITEXCNC_BOARD_DATA_WRITE_SIZE(litexcnc) LITEXCNC_WATCHDOG_DATA_WRITE_SIZE + LITEXCNC_WALLCLOCK_DATA_WRITE_SIZE + LITEXCNC_BOARD_GPIO_DATA_WRITE_SIZE(litexcnc) + LITEXCNC_BOARD_PWM_DATA_WRITE_SIZE(litexcnc) + LITEXCNC_BOARD_STEPGEN_DATA_WRITE_SIZE(litexcnc) + LITEXCNC_BOARD_ENCODER_DATA_WRITE_SIZE(litexcnc)
-#define LITEXCNC_BOARD_DATA_READ_SIZE(litexcnc) LITEXCNC_WATCHDOG_DATA_READ_SIZE + LITEXCNC_WALLCLOCK_DATA_READ_SIZE + LITEXCNC_BOARD_GPIO_DATA_READ_SIZE(litexcnc) + LITEXCNC_BOARD_PWM_DATA_READ_SIZE(litexcnc) + LITEXCNC_BOARD_STEPGEN_DATA_READ_SIZE(litexcnc) + LITEXCNC_BOARD_ENCODER_DATA_READ_SIZE(litexcnc)
-
 typedef struct litexcnc_fpga_struct litexcnc_fpga_t;
 struct litexcnc_fpga_struct {
     char name[HAL_NAME_LEN+1];
     int comp_id;
     uint32_t version;
     uint32_t fingerprint;
+    uint32_t layout;  // Hash of the layout of the registers on the FPGA (see `litexcnc_layout_hash`)
 
     // Functions to verify the board and reset the board
     // - on success these two return TRUE (not zero)
@@ -76,31 +103,145 @@ struct litexcnc_fpga_struct {
     int (*write_config)(litexcnc_fpga_t *self, uint8_t *data, size_t size);
 
     // Functions to read and write data from the board
-    // - on success these two return TRUE (not zero)
-    // - on failure they return FALSE (0) and set *self->io_error (below) to TRUE
+    // - on success these two return 0
+    // - on failure they return a negative value, *self->io_error (below) is then set
+    // - the read returns a positive value when no data is available yet, which is not a
+    //   failure (the previous state is kept)
     int (*read)(litexcnc_fpga_t *self);
     int (*write)(litexcnc_fpga_t *self);
+    // Function to write the data and read back the data in a single transaction. This
+    // function is optional, when the low-level driver does not support it, it should
+    // be left NULL and the `communicate` function will not be exported.
+    int (*communicate)(litexcnc_fpga_t *self);
+    // Set when reading or writing fails (HAL pin `io-error`). The pin is not reset by the
+    // driver, so short interruptions of the communication are visible as well.
     hal_bit_t *io_error;
+    // The period of the thread in which the data is read and written (in nanoseconds),
+    // so the low-level driver can derive its deadlines from it.
+    long period;
+    // The data of the modules which run at a low rate is located at the end of the read
+    // buffer (see `litexcnc_slow_rate_t`). This data is only read when requested, the
+    // low-level driver indicates whether the data of the last read contains it. A
+    // low-level driver which always reads all data sets `received` with each read.
+    struct {
+        size_t read_size;
+        bool requested;
+        bool received;
+    } slow_rate;
+    // The time the functions to verify, reset and configure the board may wait for the
+    // FPGA (in nanoseconds). Zero when loading the driver, the low-level driver then uses
+    // its default timeouts. Set while the link is recovered (see `litexcnc_link_t`), so
+    // the recovery does not make the thread overrun its period.
+    long timeout;
+    // The number of periods the data returned by the last read lags behind. Zero when
+    // the request has been made in the read itself, one when the request has been sent
+    // at the end of the previous period (pipelined read).
+    uint8_t read_lag;
 
     // Functions which will be called during various stages
     int (*post_register)(litexcnc_fpga_t *self);
 
+    // The size of the configuration data (general settings and the settings of the modules)
+    size_t config_size;
+
     // Buffers for reading and writing data
     uint8_t *write_buffer;
     size_t write_header_size;
+    size_t write_footer_size;  // Space after the data, reserved for the low-level driver
     size_t write_buffer_size;
+    // The size of the data at the start of the write buffer (after the header) which
+    // changes only occasionally (GPIO, PWM, encoder). The data after it (watchdog,
+    // stepgen) changes each period.
+    size_t write_slow_size;
     uint8_t *read_buffer;
     size_t read_header_size;
     size_t read_buffer_size;
     
     // For the low-level driver to hang their struct on
     void *private;  
+    // The board this FPGA belongs to (set by litexcnc_register)
+    litexcnc_t *litexcnc;
 };
 
+// The state of the link with the FPGA. When the communication fails for a number of
+// consecutive periods the link is lost. No data is written to the FPGA anymore, so the
+// watchdog on the FPGA disables the outputs. The link is then recovered in the write
+// function, one step per period:
+//  - LOST: the outputs are held for `link-hold-cycles` periods;
+//  - VERIFY: the FPGA must respond with the expected version and fingerprint;
+//  - RESET: the FPGA is reset to its initial state;
+//  - CONFIG: the configuration is written and the stepgens and wall clock are aligned
+//    with the FPGA again, after which the data is exchanged as before.
+// A step which fails restarts the recovery from LOST.
+typedef enum {
+    LITEXCNC_LINK_UP = 0,
+    LITEXCNC_LINK_LOST,
+    LITEXCNC_LINK_VERIFY,
+    LITEXCNC_LINK_RESET,
+    LITEXCNC_LINK_CONFIG
+} litexcnc_link_state_t;
+
+// Defaults for the detection of the loss of the link
+#define LITEXCNC_LINK_DEFAULT_LOSS_CYCLES 10
+#define LITEXCNC_LINK_DEFAULT_HOLD_CYCLES 100
+// The fraction of the period each step of the recovery may wait for the FPGA
+#define LITEXCNC_LINK_STEP_BUDGET 0.5
+
+typedef struct {
+    struct {
+        hal_bit_t *up;          // The link with the FPGA is working
+        hal_u32_t *recoveries;  // Number of times the link has been recovered
+    } pin;
+    struct {
+        hal_u32_t loss_cycles;  // Number of failed periods after which the link is lost (0 disables the recovery)
+        hal_u32_t hold_cycles;  // Number of periods the outputs are held before a recovery is attempted
+    } param;
+} litexcnc_link_hal_t;
+
+// Hand-over of data between two threads. The sequence number is odd while the data is
+// being copied, so the thread receiving the data detects a copy which has been
+// interrupted, without any of the threads having to wait for the other.
+typedef struct {
+    uint8_t *data;
+    uint32_t sequence;
+} litexcnc_handover_t;
+
+// The data of the modules which may run at a low rate (GPIO, PWM) can be exchanged by
+// separate functions (`read-slow` and `write-slow`), which are added to a slow thread.
+// The functions of the fast thread (`read-fast` and `write-fast`) then only process the
+// other modules. All communication with the FPGA is performed by the fast thread: the
+// data written by the slow thread is sent along when it has changed, and the data for
+// the slow thread is only read when the slow thread has asked for it. The data of
+// these modules is located at the start of the write buffer and at the end of the
+// read buffer.
+typedef struct {
+    size_t write_size;
+    size_t read_size;
+    // Data from the slow thread to the fast thread and vice versa
+    litexcnc_handover_t write;
+    litexcnc_handover_t read;
+    // Buffers of the slow thread
+    uint8_t *write_data;
+    uint8_t *read_data;
+    uint32_t read_seen;   // Sequence number of the data last processed
+    bool read_requested;  // Set by the slow thread, reset when the data has been read
+    // Buffers of the fast thread: the last complete copy of the data written
+    uint8_t *write_copy;
+    uint32_t write_seen;
+} litexcnc_slow_rate_t;
+
+typedef struct {
+    litexcnc_link_hal_t *hal;
+    litexcnc_link_state_t state;
+    uint32_t failed_cycles;  // Number of consecutive periods in which the read failed
+    uint32_t hold_cycles;    // Number of periods the outputs have been held
+    uint64_t lost_time;      // Time of the last succesful read before the link was lost (CLOCK_MONOTONIC, in nanoseconds)
+} litexcnc_link_t;
+
 struct litexcnc_struct {
     litexcnc_fpga_t *fpga;
     uint32_t clock_frequency;
-    float clock_frequency_recip;
+    double clock_frequency_recip;
 
     struct {
         size_t num_gpio_inputs;
@@ -108,6 +249,9 @@ struct litexcnc_struct {
         size_t num_pwm_instances;
         size_t num_stepgen_instances;
         size_t num_encoder_instances;
+        // The status of the FPGA is sent in the compact format (32-bit wall clock and
+        // stepgen positions), see the JSON key `compact_status`
+        bool compact_status;
     } config;
 
     // The fingerprint of the FPGA and driver
@@ -118,6 +262,30 @@ struct litexcnc_struct {
     bool write_loop_has_run;
     bool read_loop_has_run;
 
+    // The number of periods between reading the status of the FPGA and writing the data
+    // which has been calculated with it. With the separate read and write functions this
+    // lag is zero, unless the read is pipelined; with the communicate function the data
+    // is written at the start of the next period, together with the read request.
+    uint8_t write_lag;
+
+    // The state of the link with the FPGA
+    litexcnc_link_t link;
+
+    // The modules with data on this board, in the order of the data (see
+    // `litexcnc_setup_modules`). Modules without data are not called each period. The
+    // modules are also split in the modules running at a high and a low rate.
+    struct {
+        litexcnc_module_list_t write;
+        litexcnc_module_list_t read;
+        litexcnc_module_list_t write_fast;
+        litexcnc_module_list_t read_fast;
+        litexcnc_module_list_t write_slow;
+        litexcnc_module_list_t read_slow;
+    } modules;
+
+    // Exchange of the data of the modules running at a low rate
+    litexcnc_slow_rate_t slow_rate;
+
     // the litexcnc "Components"
     litexcnc_watchdog_t *watchdog;
     litexcnc_wallclock_t *wallclock;
@@ -139,6 +307,7 @@ typedef struct {
     uint32_t magic;
     uint32_t version;
     uint32_t fingerprint;
+    uint32_t layout;
 } litexcnc_header_data_read_t;
 #pragma pack(pop)
 #define LITEXCNC_HEADER_DATA_READ_SIZE sizeof(litexcnc_header_data_read_t)
@@ -159,10 +328,74 @@ typedef struct {
     uint32_t loop_cycles;
 } litexcnc_config_header_t;
 #pragma pack(pop)
-#define LITEXCNC_CONFIG_HEADER_SIZE sizeof(litexcnc_config_header_t) + LITEXCNC_STEPGEN_CONFIG_DATA_SIZE
+
+// ------------------------------------
+// Registers with flags
+// ------------------------------------
+// The flags of the GPIO, the PWM (enable) and the encoders (index) are packed in
+// registers of one or more 32-bit words, flag k being bit k of the register. The words
+// are big-endian and the most significant word comes first, so the first word contains
+// the flags with the highest numbers. The flags are packed and unpacked a word at a time.
+// - the number of words for the given number of flags
+static inline size_t litexcnc_flag_words(size_t count) {
+    return (count + 31) >> 5;
+}
+// - the number of the first flag in the given word (counting from the start of the data)
+static inline size_t litexcnc_flag_first(size_t count, size_t word) {
+    return (litexcnc_flag_words(count) - 1 - word) << 5;
+}
+// - the number of flags in the given word (the last flags don't fill a complete word)
+static inline size_t litexcnc_flag_count(size_t count, size_t word) {
+    size_t first = litexcnc_flag_first(count, word);
+    return (count - first) < 32 ? (count - first) : 32;
+}
+static inline void litexcnc_flag_write(uint8_t **data, uint32_t flags) {
+    flags = htobe32(flags);
+    memcpy(*data, &flags, sizeof flags);
+    *data += sizeof flags;
+}
+static inline uint32_t litexcnc_flag_read(uint8_t **data) {
+    uint32_t flags;
+    memcpy(&flags, *data, sizeof flags);
+    *data += sizeof flags;
+    return be32toh(flags);
+}
+
+// Change detection of the inputs of an instance of a module. The instance keeps a
+// snapshot of the inputs (HAL pins and parameters) with which its derived values have
+// been calculated. Each period the inputs are gathered in a new snapshot; only when it
+// differs from the stored snapshot, the derived values have to be recalculated. The
+// snapshot is compared bytewise, so it must not contain padding.
+static inline bool litexcnc_inputs_changed(void *stored, const void *inputs, size_t size, bool *valid) {
+    if (*valid && (memcmp(stored, inputs, size) == 0)) {
+        return false;
+    }
+    memcpy(stored, inputs, size);
+    *valid = true;
+    return true;
+}
+#define LITEXCNC_INPUTS_CHANGED(memo, inputs) litexcnc_inputs_changed(&(memo).inputs, &(inputs), sizeof(inputs), &(memo).inputs_valid)
+
+// Buffers exchanged with the FPGA are aligned to a cache line and padded to a whole
+// number of cache lines, so buffers used by different threads never share a cache line.
+// The buffers are released with `free`.
+#define LITEXCNC_CACHE_LINE_SIZE 64
+static inline uint8_t *litexcnc_alloc_buffer(size_t size) {
+    void *buffer;
+    size = (size + LITEXCNC_CACHE_LINE_SIZE - 1) & ~((size_t) LITEXCNC_CACHE_LINE_SIZE - 1);
+    if (posix_memalign(&buffer, LITEXCNC_CACHE_LINE_SIZE, size) != 0) {
+        return NULL;
+    }
+    memset(buffer, 0, size);
+    return buffer;
+}
 
 int litexcnc_load_config(const char *config_file, cJSON **config, uint32_t *fingerprint) ;
 int litexcnc_register(litexcnc_fpga_t *fpga, cJSON *config, uint32_t fingerprint);
 void litexcnc_unregister(litexcnc_fpga_t *fpga);
+// Functions for low-level drivers which serve multiple boards in a single function. These
+// perform the same actions as the read and write functions exported to the HAL.
+void litexcnc_read_fpga(litexcnc_fpga_t *fpga, long period);
+void litexcnc_write_fpga(litexcnc_fpga_t *fpga, long period);
 
 #endif
@@ -15,7 +15,13 @@
 //    along with this program; if not, write to the Free Software
 //    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
 //
+// Required for sendmmsg and recvmmsg (etherbone.c, which is included below)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <stdio.h>
+#include <poll.h>
+#include <time.h>
 
 #include <rtapi_slab.h>
 #include <rtapi_list.h>
@@ -27,6 +33,8 @@
 
 #include "cJSON/cJSON.h"
 #include "etherbone.h"
+#include "etherbone_raw.h"
+#include "etherbone_xdp.h"
 #include "litexcnc.h"
 #include "litexcnc_eth.h"
 
@@ -40,7 +48,10 @@ static int comp_id;
 static int boards_count = 0;
 static struct rtapi_list_head board_num;
 static struct rtapi_list_head ifnames;
-static litexcnc_eth_t* boards[MAX_ETH_BOARDS];
+static struct rtapi_list_head boards;
+// Used to wait for the responses of all boards at once (see `litexcnc_eth_all_read`)
+static struct pollfd *poll_fds;
+static litexcnc_eth_t **poll_boards;
 
 
 // Create a dictionary structure to store card information and being able
@@ -79,6 +90,43 @@ static void dict_free(struct rtapi_list_head *head) {
     }
 }
 
+static bool litexcnc_eth_worker_idle(litexcnc_eth_worker_t *worker);
+
+
+static uint64_t litexcnc_eth_time_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+static int litexcnc_eth_limit_wait(litexcnc_fpga_t *this) {
+    /*
+     * Limits the time the functions to verify, reset and configure the board wait for
+     * the FPGA to the timeout set by the LitexCNC driver. When the timeout is zero
+     * (loading of the driver), the default timeout of the transport is used. The
+     * deadline is left in place, the functions reading the data set their own deadline.
+     *
+     * These functions are also used when the link with the FPGA is recovered. The
+     * connection should then not be in use by the I/O worker anymore and the responses
+     * to earlier requests are removed.
+     */
+    litexcnc_eth_t *board = this->private;
+
+    if (board->worker) {
+        if (!litexcnc_eth_worker_idle(board->worker)) {
+            return -1;
+        }
+        board->worker->consumed = board->worker->posted;
+    }
+    eb_set_rx_deadline(board->connection, this->timeout ? litexcnc_eth_time_ns() + this->timeout : 0);
+    eb_discard_pending_packets(board->connection);
+    board->read_pending = false;
+    board->read_timed_out = false;
+    return 0;
+}
+
+
 static int litexcnc_eth_verify_config(litexcnc_fpga_t *this) {
     /*
      * This function reads the magic code (should be equal to 0x18052022) and if the
@@ -90,7 +138,10 @@ static int litexcnc_eth_verify_config(litexcnc_fpga_t *this) {
 
     // Create a buffer to contain both the magic number and the config fingerprint. Both
     // parameters are stored in as 32-bit unsigned integers
-    uint8_t *read_buffer = rtapi_kmalloc(LITEXCNC_HEADER_DATA_READ_SIZE, RTAPI_GFP_KERNEL);
+    uint8_t read_buffer[LITEXCNC_HEADER_DATA_READ_SIZE];
+    if (litexcnc_eth_limit_wait(this) < 0) {
+        return -1;
+    }
 
     // Read the magic and fingerprint. These are the first registers on the card
     int r = eb_read8(
@@ -114,9 +165,10 @@ static int litexcnc_eth_verify_config(litexcnc_fpga_t *this) {
         return -1;
     }
 
-    // Store version and fingerprint
+    // Store version, fingerprint and the hash of the layout of the registers
     this->version = be32toh(header.version);
     this->fingerprint = be32toh(header.fingerprint);
+    this->layout = be32toh(header.layout);
 
     // Succesfull finish
     return 0;
@@ -138,7 +190,12 @@ static int litexcnc_eth_reset(litexcnc_fpga_t *this) {
 
     // Create a buffer to contain both the magic number and the config fingerprint. Both
     // parameters are stored in as 32-bit unsigned integers
-    uint8_t *buffer = rtapi_kmalloc(LITEXCNC_RESET_HEADER_SIZE, RTAPI_GFP_KERNEL);
+    uint8_t buffer[LITEXCNC_RESET_HEADER_SIZE];
+    if (litexcnc_eth_limit_wait(this) < 0) {
+        return -1;
+    }
+    // After the reset all data has to be sent to the FPGA again
+    board->write_refresh = true;
 
     // Initialize a variables for resetting the card and the current status
     size_t i;
@@ -166,15 +223,18 @@ static int litexcnc_eth_reset(litexcnc_fpga_t *this) {
         );
         // Wait for a bit before requesting the data
         usecSleep(10);
-        // Read the data back
-        eb_read8(
-            board->connection, 
-            LITEXCNC_ETH_RESET_DATA_BASE_ADDRESS(this), 
-            buffer, 
-            LITEXCNC_RESET_HEADER_SIZE,
-            0
-        );
-        memcpy(&reset_status, buffer, LITEXCNC_RESET_HEADER_SIZE);
+        // Read the data back. When no response is received, the status is unknown and
+        // the data is written again.
+        if (eb_read8(
+                board->connection, 
+                LITEXCNC_ETH_RESET_DATA_BASE_ADDRESS(this), 
+                buffer, 
+                LITEXCNC_RESET_HEADER_SIZE,
+                0) < 0) {
+            reset_status = ~reset_flag;
+        } else {
+            memcpy(&reset_status, buffer, LITEXCNC_RESET_HEADER_SIZE);
+        }
         // Proceed counter
         i++;
     }
@@ -199,15 +259,18 @@ static int litexcnc_eth_reset(litexcnc_fpga_t *this) {
         );
         // Wait for a bit before requesting the data
         usecSleep(10);
-        // Read the data back
-        eb_read8(
-            board->connection, 
-            LITEXCNC_ETH_RESET_DATA_BASE_ADDRESS(this), 
-            buffer, 
-            LITEXCNC_RESET_HEADER_SIZE,
-            0
-        );
-        memcpy(&reset_status, buffer, LITEXCNC_RESET_HEADER_SIZE);
+        // Read the data back. When no response is received, the status is unknown and
+        // the data is written again.
+        if (eb_read8(
+                board->connection, 
+                LITEXCNC_ETH_RESET_DATA_BASE_ADDRESS(this), 
+                buffer, 
+                LITEXCNC_RESET_HEADER_SIZE,
+                0) < 0) {
+            reset_status = ~reset_flag;
+        } else {
+            memcpy(&reset_status, buffer, LITEXCNC_RESET_HEADER_SIZE);
+        }
         // Proceed counter
         i++;
     }
@@ -222,94 +285,880 @@ static int litexcnc_eth_write_config(litexcnc_fpga_t *this, uint8_t *data, size_
      */
     litexcnc_eth_t *board = this->private;
 
-    eb_write8(
+    if (litexcnc_eth_limit_wait(this) < 0) {
+        return -1;
+    }
+    int r = eb_write8(
         board->connection, 
         LITEXCNC_ETH_CONFIG_DATA_BASE_ADDRESS(this), 
         data, 
-        LITEXCNC_CONFIG_HEADER_SIZE,
+        size,
         board->hal.param.debug
     );
-    // if (r < 0) {
-    //     fprintf(stderr, "Could not write config to device `%s`, error code %d", this->name, r);
-    //     return -1;
-    // }
+    if (r < 0) {
+        fprintf(stderr, "Could not write config to device `%s`, error code %d", this->name, r);
+        return -1;
+    }
 
     // It is not (yet) implemented to read back the configuration from the device
     // in order to check whether the write has been successful.
     return 0;
 }
 
-static int litexcnc_eth_read(litexcnc_fpga_t *this) {
+static void litexcnc_eth_set_sequence(uint8_t *location, uint32_t sequence) {
+    sequence = htobe32(sequence);
+    memcpy(location, &sequence, sizeof(sequence));
+}
+
+
+static size_t litexcnc_eth_chunk_words(size_t words, size_t chunk) {
+    // The number of words in the given chunk, when the words are split in chunks of
+    // at most EB_MAX_RECORD_WORDS words
+    size_t remaining = words - chunk * EB_MAX_RECORD_WORDS;
+    return remaining < EB_MAX_RECORD_WORDS ? remaining : EB_MAX_RECORD_WORDS;
+}
+
+
+static int litexcnc_eth_sendv(litexcnc_eth_t *board, const struct iovec *iov, int iovcnt) {
+    /*
+     * Sends a packet to the board. When the boards are served together (see the function
+     * `litexcnc_eth_all_read`), the first packet is queued, so the packets of all boards
+     * can be sent in a single batch. Any further packets of the board are sent directly,
+     * after the queued packet.
+     */
+    if (board->batch && (iovcnt <= LITEXCNC_ETH_BATCH_IOV) && (iov[0].iov_len <= sizeof(board->batch_header))) {
+        board->batch = false;
+        memcpy(board->batch_iov, iov, iovcnt * sizeof(struct iovec));
+        memcpy(board->batch_header, iov[0].iov_base, iov[0].iov_len);
+        board->batch_iov[0].iov_base = board->batch_header;
+        board->batch_iovcnt = iovcnt;
+        return 0;
+    }
+    board->batch = false;
+    if (board->batch_iovcnt) {
+        int r = eb_sendv(board->connection, board->batch_iov, board->batch_iovcnt);
+        board->batch_iovcnt = 0;
+        if (r < 0) {
+            return r;
+        }
+    }
+    return eb_sendv(board->connection, iov, iovcnt);
+}
+
+
+static void litexcnc_eth_set_read_words(litexcnc_fpga_t *this) {
+    /*
+     * Sets the number of words to read with the next request. The data of the modules
+     * running at a low rate is located at the end of the read buffer, it is left out
+     * when it has not been requested. Only the counts of the requests are modified, the
+     * requests have been created for all data.
+     */
     litexcnc_eth_t *board = this->private;
-    static int r;
-    
-    // This is essential as the colorlight card crashes when two packets come close to each other.
-	// This prevents crashes in the litex eth core. 
-	// Also turn of mDNS request from linux to the colorlight card. (avahi-daemon)
-	eb_wait_for_tx_buffer_empty(board->connection);
+    size_t words = (this->read_buffer_size - 16 - (this->slow_rate.requested ? 0 : this->slow_rate.read_size)) >> 2;
+    if (words == board->read_words) {
+        return;
+    }
+    board->read_words = words;
+    board->read_chunks = (words + EB_MAX_RECORD_WORDS - 1) / EB_MAX_RECORD_WORDS;
+    for (size_t i=0; i<board->read_chunks; i++) {
+        ((uint8_t *) board->read_requests[i].iov_base)[11] = litexcnc_eth_chunk_words(words, i);
+    }
+}
 
-    // Read the data (etherbone.h)
-    // - send request
-    r = eb_send(
-        board->connection,
-        board->read_request_buffer,
-        this->read_buffer_size);
+
+static int litexcnc_eth_send_read_requests(litexcnc_fpga_t *this, size_t first) {
+    // Sends the (remaining) requests for data, each request is a separate packet
+    litexcnc_eth_t *board = this->private;
+    for (size_t i=first; i<board->read_chunks; i++) {
+        int r = litexcnc_eth_sendv(board, &board->read_requests[i], 1);
+        if (r < 0) {
+            return r;
+        }
+    }
+    return 0;
+}
+
+
+static size_t litexcnc_eth_first_dirty_word(litexcnc_fpga_t *this) {
+    /*
+     * Returns the index of the first word of the data which has to be sent to the FPGA.
+     * The data which changes only occasionally (GPIO, PWM, encoder) is located at the
+     * start of the buffer, so the words which are equal to the data sent last time can
+     * be skipped. All data is sent periodically and after a failure, so the FPGA is
+     * brought back in sync when a packet has been lost.
+     */
+    litexcnc_eth_t *board = this->private;
+    const uint8_t *data = this->write_buffer + this->write_header_size;
+    size_t words = this->write_slow_size >> 2;
+    size_t first = 0;
+
+    board->writes_since_refresh++;
+    if (board->write_refresh || (board->writes_since_refresh >= board->hal.param.write_refresh_period)) {
+        board->write_refresh = false;
+        board->writes_since_refresh = 0;
+    } else if (memcmp(data, board->write_shadow, this->write_slow_size) == 0) {
+        first = words;
+    } else {
+        while ((first < words) && (memcmp(data + (first << 2), board->write_shadow + (first << 2), 4) == 0)) {
+            first++;
+        }
+    }
+    memcpy(board->write_shadow, data, this->write_slow_size);
+    return first;
+}
+
+
+static void litexcnc_eth_skip_words(uint8_t *header, size_t skip) {
+    // Modifies the header of a record, so the first words of the record are not written
+    uint32_t address;
+    memcpy(&address, &header[12], sizeof(address));
+    address = htobe32(be32toh(address) + (skip << 2));
+    memcpy(&header[12], &address, sizeof(address));
+    header[10] -= skip;
+}
+
+
+static int litexcnc_eth_send_in_place(litexcnc_fpga_t *this, bool request_read, size_t first) {
+    /*
+     * The data has been written in place in a frame of the transport, only the
+     * addresses to read have to be added before the frame is sent. This is only used
+     * when the write data and the request for data fit in a single packet. The words
+     * which are not sent are removed by moving the remaining data directly behind the
+     * header.
+     */
+    litexcnc_eth_t *board = this->private;
+    uint8_t header[16];
+
+    memcpy(header, this->write_buffer, sizeof(header));
+    size_t len = this->write_buffer_size;
+    if (first) {
+        memmove(
+            this->write_buffer + 16, 
+            this->write_buffer + 16 + (first << 2), 
+            len - 16 - (first << 2));
+        litexcnc_eth_skip_words(this->write_buffer, first);
+        len -= first << 2;
+    }
+    if (request_read) {
+        memcpy(
+            this->write_buffer + len,
+            (uint8_t *) board->read_requests[0].iov_base + LITEXCNC_ETH_HEADER_SIZE,
+            board->read_requests[0].iov_len - LITEXCNC_ETH_HEADER_SIZE);
+        len += board->read_requests[0].iov_len - LITEXCNC_ETH_HEADER_SIZE;
+    }
+    int r = eb_send_tx_buffer(board->connection, this->write_buffer, len);
+    // Continue with the next frame, the header is copied from the frame just sent. When
+    // no frame is available, the buffer of the driver is used for the next period.
+    uint8_t *next = eb_alloc_tx_buffer(board->connection);
+    if (!next) {
+        next = board->write_buffer_static;
+    }
+    memcpy(next, header, sizeof(header));
+    this->write_buffer = next;
+    return r;
+}
+
+
+static int litexcnc_eth_send_data(litexcnc_fpga_t *this, bool request_read) {
+    /*
+     * This function sends the write buffer to the FPGA. When requested, the addresses
+     * to read are added to the same record, so the FPGA responds with the status of
+     * the FPGA directly after the data has been written.
+     *
+     * Large configurations are split over multiple packets. The request for data is
+     * then added to the last packet with data (when it fits), the remaining requests
+     * are sent as separate packets.
+     *
+     * The data at the start of the buffer which has not changed since the last write
+     * is not sent. Packets which only contain such data are skipped entirely.
+     */
+    litexcnc_eth_t *board = this->private;
+    size_t first = litexcnc_eth_first_dirty_word(this);
+
+    // Each request for data gets a new sequence number, which is echoed in the response
+    if (request_read) {
+        litexcnc_eth_set_read_words(this);
+        board->sequence++;
+        litexcnc_eth_set_sequence(board->read_request_buffer + 16, board->sequence);
+    }
+    litexcnc_eth_set_sequence(this->write_buffer + this->write_buffer_size - this->write_footer_size, board->sequence);
+    this->write_buffer[8] = request_read ? board->read_request_buffer[8] : 0;
+    this->write_buffer[11] = request_read ? board->read_request_buffer[11] : 0;
+    if (board->in_place && (this->write_buffer != board->write_buffer_static)) {
+        return litexcnc_eth_send_in_place(this, request_read, first);
+    }
+
+    // Each packet contains the header and the data, the last packet can contain the
+    // first request for data (without the header and sequence number): the return
+    // address and the address of the first word to read.
+    size_t words = (this->write_buffer_size - 16) >> 2;
+    for (size_t i=first / EB_MAX_RECORD_WORDS; i<board->write_chunks; i++) {
+        uint8_t header[16];
+        size_t skip = first > i * EB_MAX_RECORD_WORDS ? first - i * EB_MAX_RECORD_WORDS : 0;
+        bool attach = request_read && board->read_attached && (i == board->write_chunks - 1);
+        memcpy(header, i == 0 ? this->write_buffer : board->write_chunk_headers + ((i - 1) << 4), sizeof(header));
+        header[8] = attach ? board->read_request_buffer[8] : 0;
+        header[11] = attach ? board->read_request_buffer[11] : 0;
+        litexcnc_eth_skip_words(header, skip);
+        struct iovec iov[3] = {
+            {.iov_base = header,                                                                  .iov_len = 16},
+            {.iov_base = this->write_buffer + 16 + ((i * EB_MAX_RECORD_WORDS + skip) << 2),       .iov_len = (litexcnc_eth_chunk_words(words, i) - skip) << 2},
+            {.iov_base = (uint8_t *) board->read_requests[0].iov_base + LITEXCNC_ETH_HEADER_SIZE, .iov_len = board->read_requests[0].iov_len - LITEXCNC_ETH_HEADER_SIZE}
+        };
+        int r = litexcnc_eth_sendv(board, iov, attach ? 3 : 2);
+        if (r < 0) {
+            return r;
+        }
+    }
+    if (request_read) {
+        return litexcnc_eth_send_read_requests(this, board->read_attached ? 1 : 0);
+    }
+    return 0;
+}
+
+
+static uint64_t litexcnc_eth_deadline(litexcnc_eth_t *board, long period) {
+    // The response is awaited for a fraction of the period, so a lost packet does not
+    // make the thread overrun its period.
+    double fraction = board->hal.param.recv_deadline > 0 ? board->hal.param.recv_deadline : 0;
+    return litexcnc_eth_time_ns() + (uint64_t) (fraction * period);
+}
+
+
+static int litexcnc_eth_receive_packets(litexcnc_fpga_t *this) {
+    /*
+     * Receives the response to the last request for data. Responses to earlier requests
+     * (which arrived after the read has timed out) are recognized by their sequence
+     * number and dropped. For large configurations the data is received in multiple
+     * packets, which are stored consecutively in the read buffer.
+     */
+    litexcnc_eth_t *board = this->private;
+    size_t words = board->read_words;
+    size_t expected = 16 + (litexcnc_eth_chunk_words(words, 0) << 2);
+    int count;
+
+    while (1) {
+        const uint8_t *response = this->read_buffer;
+        if (board->in_place) {
+            // Give the frame of the previous response back to the transport and receive
+            // the response in place. The buffer of the driver is used when nothing is
+            // received.
+            if (board->rx_frame) {
+                eb_release_rx_buffer(board->connection, board->rx_frame);
+                board->rx_frame = NULL;
+            }
+            this->read_buffer = board->read_buffer_static;
+            uint8_t *frame;
+            count = eb_recv_in_place(board->connection, &frame);
+            if (count >= 0) {
+                board->rx_frame = frame;
+                response = frame;
+                if (count == expected) {
+                    this->read_buffer = frame;
+                }
+            }
+        } else {
+            count = eb_recv(
+                board->connection, 
+                this->read_buffer,
+                expected);
+        }
+        // - check the response belongs to the request. Responses to earlier requests can
+        //   differ in size, as the data of the modules running at a low rate is not 
+        //   requested each time.
+        if (count >= LITEXCNC_ETH_HEADER_SIZE) {
+            uint32_t sequence;
+            memcpy(&sequence, &response[16], sizeof(sequence));
+            if (be32toh(sequence) != board->sequence) {
+                (*board->hal.pin.stale_packets)++;
+                continue;
+            }
+        }
+        // - check size is expexted size
+        if (count != expected) {
+            fprintf(stderr, "Unexpected read length: %d, expected %zu\n", count, expected);
+            board->write_refresh = true;
+            return -1;
+        }
+        break;
+    }
+
+    // Receive the remaining packets, the headers of these packets are not stored
+    for (size_t i=1; i<board->read_chunks; i++) {
+        uint8_t header[16];
+        size_t chunk = litexcnc_eth_chunk_words(words, i) << 2;
+        struct iovec iov[2] = {
+            {.iov_base = header,                                                   .iov_len = sizeof(header)},
+            {.iov_base = this->read_buffer + 16 + ((i * EB_MAX_RECORD_WORDS) << 2), .iov_len = chunk}
+        };
+        count = eb_recvv(board->connection, iov, 2);
+        if (count != 16 + chunk) {
+            fprintf(stderr, "Unexpected read length: %d, expected %zu\n", count, 16 + chunk);
+            board->write_refresh = true;
+            return -1;
+        }
+    }
+
+    this->slow_rate.received = (16 + (words << 2)) == this->read_buffer_size;
+    return 0;
+}
+
+
+static int litexcnc_eth_receive_data(litexcnc_fpga_t *this, uint64_t deadline) {
+    // Receives the response, waiting until the deadline at most
+    litexcnc_eth_t *board = this->private;
+    eb_set_busy_poll(board->connection, board->hal.param.busy_poll);
+    eb_set_rx_deadline(board->connection, deadline);
+    int r = litexcnc_eth_receive_packets(this);
+    eb_set_rx_deadline(board->connection, 0);
+    return r;
+}
+
+
+static void litexcnc_eth_discard_pending_packets(litexcnc_eth_t *board) {
+    // Late responses to earlier requests are removed before a new request is sent, so
+    // they don't queue up.
+    *board->hal.pin.stale_packets += eb_discard_pending_packets(board->connection);
+}
+
+
+static void litexcnc_eth_apply_tx_gap(litexcnc_eth_t *board) {
+    // This is essential as the colorlight card crashes when two packets come close to
+    // each other. The packets are spaced by the transport with the minimum gap (see
+    // `eb_set_tx_gap`). Also turn off the mDNS requests from Linux to the colorlight
+    // card (avahi-daemon).
+    eb_set_tx_gap(board->connection, board->hal.param.tx_gap_ns, board->hal.param.tx_launch_time);
+}
+
+
+static int litexcnc_eth_request_data(litexcnc_fpga_t *this) {
+    litexcnc_eth_t *board = this->private;
+    int r;
+
+    litexcnc_eth_apply_tx_gap(board);
+
+    // Send the request for data (etherbone.h)
+    litexcnc_eth_discard_pending_packets(board);
+    litexcnc_eth_set_read_words(this);
+    litexcnc_eth_set_sequence(board->read_request_buffer + 16, ++board->sequence);
+    r = litexcnc_eth_send_read_requests(this, 0);
     if (r < 0) {
         fprintf(stderr, "Could not write addresses to read to device `%s`, error code %d", this->name, r);
         return -1;
     }
-    // - get response
-    int count = eb_recv(
-        board->connection, 
-        this->read_buffer,
-        this->read_buffer_size);
-    // - check size is expexted size
-    if (count != this->read_buffer_size) {
-        fprintf(stderr, "Unexpected read length: %d, expected %zu\n", count, this->read_buffer_size);
+    return 0;
+}
+
+
+static int litexcnc_eth_read(litexcnc_fpga_t *this) {
+    litexcnc_eth_t *board = this->private;
+    uint64_t deadline = board->read_deadline ? board->read_deadline : litexcnc_eth_deadline(board, this->period);
+    board->read_deadline = 0;
+
+    // The function serving all boards did not receive a response in time
+    if (board->read_timed_out) {
+        board->read_timed_out = false;
+        board->write_refresh = true;
         return -1;
     }
-    
-    // Successful read
-    return 0;
+
+    // In pipelined mode the read request has already been sent together with the
+    // data in the previous write, so the response is already waiting. The data then
+    // belongs to the status of the FPGA at the end of the previous period. The same
+    // holds for the request sent by the function serving all boards, although the 
+    // data then belongs to this period.
+    if (board->read_pending) {
+        board->read_pending = false;
+        this->read_lag = board->read_pending_lag;
+        return litexcnc_eth_receive_data(this, deadline);
+    }
+    this->read_lag = 0;
+
+    // Read the data
+    // - send request
+    if (litexcnc_eth_request_data(this) < 0) {
+        return -1;
+    }
+    // - get response
+    return litexcnc_eth_receive_data(this, deadline);
 }
 
 static int litexcnc_eth_write(litexcnc_fpga_t *this) {
     litexcnc_eth_t *board = this->private;
-    static int r;
+    int r;
     
-    // This is essential as the colorlight card crashes when two packets come close
-    // to each other. This prevents crashes in the litex eth core. 
-	// Also turn of mDNS request from linux to the colorlight card. (avahi-daemon)
-	eb_wait_for_tx_buffer_empty(board->connection);
-
-    // Write the data (etberbone.h)
-    r = eb_send(
-        board->connection,
-        this->write_buffer,
-        this->write_buffer_size);
+    litexcnc_eth_apply_tx_gap(board);
+
+    // Write the data (etberbone.h). In pipelined mode the read request for the next
+    // period is sent along, so the round trip is made during the idle part of the
+    // period.
+    if (board->hal.param.pipelined) {
+        litexcnc_eth_discard_pending_packets(board);
+    }
+    r = litexcnc_eth_send_data(this, board->hal.param.pipelined);
     if (r < 0) {
         fprintf(stderr, "Could not write data to device `%s`, error code %d", this->name, r);
+        board->read_pending = false;
+        board->write_refresh = true;
         return -1;
     }
-
-    // If we missed a paket earlier with timeout AND this packet arrives later, there 
-    // can be a queue of packet. Test here if anoter packet is ready ( no delay) and 
-    // discard that packet to avoid such a queue.
-	//eb_discard_pending_packet(board->connection, this->write_buffer_size);
+    board->read_pending = board->hal.param.pipelined;
+    board->read_pending_lag = 1;
 
     return r;
 }
 
 
+static int litexcnc_eth_communicate(litexcnc_fpga_t *this) {
+    litexcnc_eth_t *board = this->private;
+    uint64_t deadline = litexcnc_eth_deadline(board, this->period);
+    int r;
+
+    litexcnc_eth_apply_tx_gap(board);
+
+    // Write the data and the addresses to read in a single record. 
+    litexcnc_eth_discard_pending_packets(board);
+    r = litexcnc_eth_send_data(this, true);
+    if (r < 0) {
+        fprintf(stderr, "Could not communicate with device `%s`, error code %d", this->name, r);
+        board->write_refresh = true;
+        return -1;
+    }
+    // - get response
+    return litexcnc_eth_receive_data(this, deadline);
+}
+
+
+static void *litexcnc_eth_worker_main(void *arg) {
+    /*
+     * Performs the communication with the board on behalf of the HAL thread. For each
+     * request the data is written (when given) and the status of the FPGA is read. The
+     * worker blocks in the system calls, so the HAL thread doesn't have to.
+     */
+    litexcnc_eth_t *board = arg;
+    litexcnc_eth_worker_t *worker = board->worker;
+    litexcnc_fpga_t *fpga = &worker->fpga;
+
+    while (1) {
+        while (sem_wait(&worker->wakeup) < 0 && errno == EINTR);
+        if (__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        uint32_t request = __atomic_load_n(&worker->posted, __ATOMIC_ACQUIRE);
+        if (request == worker->done) {
+            continue;
+        }
+        fpga->period = worker->period;
+        uint64_t deadline = litexcnc_eth_deadline(board, fpga->period);
+        int r;
+        if (worker->write) {
+            litexcnc_eth_apply_tx_gap(board);
+            litexcnc_eth_discard_pending_packets(board);
+            r = litexcnc_eth_send_data(fpga, true);
+        } else {
+            r = litexcnc_eth_request_data(fpga);
+        }
+        if (r >= 0) {
+            r = litexcnc_eth_receive_data(fpga, deadline);
+        } else {
+            board->write_refresh = true;
+        }
+        worker->result = r;
+        __atomic_store_n(&worker->done, request, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+
+static bool litexcnc_eth_worker_idle(litexcnc_eth_worker_t *worker) {
+    return __atomic_load_n(&worker->done, __ATOMIC_ACQUIRE) == worker->posted;
+}
+
+
+static void litexcnc_eth_worker_post(litexcnc_eth_t *board, bool write) {
+    litexcnc_eth_worker_t *worker = board->worker;
+    worker->write = write;
+    worker->period = board->fpga.period;
+    worker->fpga.slow_rate.requested = board->fpga.slow_rate.requested;
+    __atomic_store_n(&worker->posted, worker->posted + 1, __ATOMIC_RELEASE);
+    sem_post(&worker->wakeup);
+}
+
+
+static int litexcnc_eth_worker_read(litexcnc_fpga_t *this) {
+    /*
+     * Picks up the status of the FPGA received by the worker. The status has been
+     * requested together with the data in the previous period. When the worker has not
+     * finished yet, the read fails immediately instead of waiting for the response.
+     */
+    litexcnc_eth_t *board = this->private;
+    litexcnc_eth_worker_t *worker = board->worker;
+
+    // No request has been made (first period, or the previous request was late)
+    if (worker->consumed == worker->posted) {
+        return 1;
+    }
+    // The response is late, it is abandoned
+    if (!litexcnc_eth_worker_idle(worker)) {
+        worker->consumed = worker->posted;
+        return -1;
+    }
+    worker->consumed = worker->posted;
+    if (worker->result < 0) {
+        return -1;
+    }
+    // The buffers are swapped, the worker receives the next response in the buffer of
+    // which the data has been processed
+    uint8_t *read_buffer = this->read_buffer;
+    this->read_buffer = worker->fpga.read_buffer;
+    worker->fpga.read_buffer = read_buffer;
+    this->slow_rate.received = worker->fpga.slow_rate.received;
+    this->read_lag = 1;
+    return 0;
+}
+
+
+static int litexcnc_eth_worker_write(litexcnc_fpga_t *this) {
+    /*
+     * Hands the data over to the worker, which sends it together with the request for
+     * the status of the FPGA. When the worker is still busy with the previous request,
+     * the data is not sent.
+     */
+    litexcnc_eth_t *board = this->private;
+    litexcnc_eth_worker_t *worker = board->worker;
+
+    if (!litexcnc_eth_worker_idle(worker)) {
+        return -1;
+    }
+    // The buffers are swapped, the data for the next period is packed in the buffer
+    // which has been sent. Both buffers contain the header of the packet.
+    uint8_t *write_buffer = this->write_buffer;
+    this->write_buffer = worker->fpga.write_buffer;
+    worker->fpga.write_buffer = write_buffer;
+    litexcnc_eth_worker_post(board, true);
+    return 0;
+}
+
+
+static int litexcnc_eth_worker_communicate(litexcnc_fpga_t *this) {
+    // The status read by the worker belongs to the previous write, so the write and
+    // read are not combined in a single transaction. The status is picked up before
+    // the new data is handed over.
+    int r = litexcnc_eth_worker_read(this);
+    int w = litexcnc_eth_worker_write(this);
+    return w < 0 ? w : r;
+}
+
+
+static int litexcnc_eth_start_worker(litexcnc_eth_t *board, int cpu, int priority) {
+    /*
+     * Starts the thread which performs the communication with the board. The thread
+     * is pinned to the given CPU (when not negative) and runs with the real-time
+     * policy SCHED_FIFO. The buffers of the driver and a second set of buffers are
+     * swapped between the HAL thread and the worker.
+     */
+    litexcnc_eth_worker_t *worker = rtapi_kzalloc(sizeof(litexcnc_eth_worker_t), RTAPI_GFP_KERNEL);
+    uint8_t *write_buffer = litexcnc_alloc_buffer(board->fpga.write_buffer_size);
+    uint8_t *read_buffer = litexcnc_alloc_buffer(board->fpga.read_buffer_size);
+    if (!worker || !write_buffer || !read_buffer) {
+        LITEXCNC_ERR_NO_DEVICE("Out of memory for the I/O worker of '%s'\n", board->fpga.name);
+        goto fail;
+    }
+    worker->fpga = board->fpga;
+    memcpy(write_buffer, board->fpga.write_buffer, board->fpga.write_buffer_size);
+    if (sem_init(&worker->wakeup, 0, 0) < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Unable to create semaphore for the I/O worker of '%s'\n", board->fpga.name);
+        goto fail;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    struct sched_param param = {.sched_priority = priority};
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+    board->worker = worker;
+    int r = pthread_create(&worker->thread, &attr, litexcnc_eth_worker_main, board);
+    if (r == EPERM) {
+        // Without the permission for real-time scheduling the worker runs with the
+        // policy of the process
+        LITEXCNC_WARN_NO_DEVICE("No permission for real-time scheduling of the I/O worker of '%s'\n", board->fpga.name);
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        r = pthread_create(&worker->thread, &attr, litexcnc_eth_worker_main, board);
+    }
+    pthread_attr_destroy(&attr);
+    if (r != 0) {
+        LITEXCNC_ERR_NO_DEVICE("Unable to start the I/O worker of '%s': %s\n", board->fpga.name, strerror(r));
+        board->worker = NULL;
+        sem_destroy(&worker->wakeup);
+        goto fail;
+    }
+
+    // The functions of the HAL thread exchange the data with the worker
+    board->fpga.write_buffer = write_buffer;
+    board->fpga.read_buffer  = read_buffer;
+    board->fpga.read         = litexcnc_eth_worker_read;
+    board->fpga.write        = litexcnc_eth_worker_write;
+    board->fpga.communicate  = litexcnc_eth_worker_communicate;
+    LITEXCNC_PRINT_NO_DEVICE("Started I/O worker for '%s' (CPU %d, priority %d)\n", board->fpga.name, cpu, priority);
+    return 0;
+
+fail:
+    rtapi_kfree(worker);
+    free(write_buffer);
+    free(read_buffer);
+    return -1;
+}
+
+
+static void litexcnc_eth_stop_worker(litexcnc_eth_t *board) {
+    if (!board->worker) {
+        return;
+    }
+    litexcnc_eth_worker_t *worker = board->worker;
+    __atomic_store_n(&worker->stop, true, __ATOMIC_RELEASE);
+    sem_post(&worker->wakeup);
+    pthread_join(worker->thread, NULL);
+    sem_destroy(&worker->wakeup);
+
+    // The buffers are swapped between the HAL thread and the worker, so either of them
+    // can hold the buffers created by `litexcnc_register`. These are given back to the
+    // board, the buffers created for the worker are freed.
+    free(board->fpga.write_buffer == board->write_buffer_static ? worker->fpga.write_buffer : board->fpga.write_buffer);
+    free(board->fpga.read_buffer == board->read_buffer_static ? worker->fpga.read_buffer : board->fpga.read_buffer);
+    board->fpga.write_buffer = board->write_buffer_static;
+    board->fpga.read_buffer  = board->read_buffer_static;
+    board->fpga.read         = litexcnc_eth_read;
+    board->fpga.write        = litexcnc_eth_write;
+    board->fpga.communicate  = litexcnc_eth_communicate;
+    board->worker = NULL;
+    rtapi_kfree(worker);
+}
+
+
+static void litexcnc_eth_flush_batch(litexcnc_eth_t **batch_boards, struct eb_connection **conns, struct iovec **iovs, int *iovcnts, int count) {
+    /*
+     * Sends the packets of the given boards. When the packet of a board could not be sent,
+     * all data is sent with the next write, because the data has already been copied to the
+     * shadow of the written data. A response to a read request will not arrive, so the
+     * read fails immediately instead of waiting for it.
+     */
+    int failed[EB_MAX_BATCH];
+    if (eb_send_batch(conns, iovs, iovcnts, count, failed) == 0) {
+        return;
+    }
+    for (int i=0; i<count; i++) {
+        if (!failed[i]) {
+            continue;
+        }
+        batch_boards[i]->write_refresh = true;
+        if (batch_boards[i]->read_pending) {
+            batch_boards[i]->read_pending = false;
+            batch_boards[i]->read_timed_out = true;
+        }
+    }
+}
+
+
+static void litexcnc_eth_send_batch(void) {
+    // Sends the packets queued by all boards in a single batch
+    litexcnc_eth_t *batch_boards[EB_MAX_BATCH];
+    struct eb_connection *conns[EB_MAX_BATCH];
+    struct iovec *iovs[EB_MAX_BATCH];
+    int iovcnts[EB_MAX_BATCH];
+    int count = 0;
+    struct rtapi_list_head *ptr;
+
+    rtapi_list_for_each(ptr, &boards) {
+        litexcnc_eth_t *board = rtapi_list_entry(ptr, litexcnc_eth_t, list);
+        board->batch = false;
+        if (!board->batch_iovcnt) {
+            continue;
+        }
+        batch_boards[count] = board;
+        conns[count] = board->connection;
+        iovs[count] = board->batch_iov;
+        iovcnts[count] = board->batch_iovcnt;
+        board->batch_iovcnt = 0;
+        if (++count == EB_MAX_BATCH) {
+            litexcnc_eth_flush_batch(batch_boards, conns, iovs, iovcnts, count);
+            count = 0;
+        }
+    }
+    if (count) {
+        litexcnc_eth_flush_batch(batch_boards, conns, iovs, iovcnts, count);
+    }
+}
+
+
+static void litexcnc_eth_all_read(void *arg, long period) {
+    /*
+     * Reads the status of all boards. The requests of all boards are sent in a single
+     * batch, after which the responses are awaited together. Each board is processed as
+     * soon as its response has arrived. This way the round trips to the boards overlap,
+     * instead of taking a full round trip per board. Boards which have not responded
+     * within a period keep their previous state.
+     */
+    struct rtapi_list_head *ptr;
+    size_t pending = 0;
+    bool busy_poll = false;
+
+    // The responses are awaited for the largest fraction of the period set for the
+    // boards. Spinning is used when requested for any of the boards.
+    uint64_t deadline = 0;
+    rtapi_list_for_each(ptr, &boards) {
+        litexcnc_eth_t *board = rtapi_list_entry(ptr, litexcnc_eth_t, list);
+        uint64_t board_deadline = litexcnc_eth_deadline(board, period);
+        deadline = board_deadline > deadline ? board_deadline : deadline;
+        busy_poll = busy_poll || board->hal.param.busy_poll;
+    }
+
+    // Send the requests of all boards. Boards which are not read in the first period
+    // or while the link is lost (see `litexcnc_read`) and boards which already requested
+    // the data with the previous write (pipelined mode) don't send a request.
+    rtapi_list_for_each(ptr, &boards) {
+        litexcnc_eth_t *board = rtapi_list_entry(ptr, litexcnc_eth_t, list);
+        if (board->read_pending || board->worker || !board->fpga.litexcnc->read_loop_has_run || board->fpga.litexcnc->link.state != LITEXCNC_LINK_UP) {
+            continue;
+        }
+        board->batch = true;
+        if (litexcnc_eth_request_data(&board->fpga) < 0) {
+            board->read_timed_out = true;
+            continue;
+        }
+        board->read_pending = true;
+        board->read_pending_lag = 0;
+    }
+    litexcnc_eth_send_batch();
+
+    // Wait for the responses, with a single deadline for all boards. In busy-poll mode
+    // the sockets are polled without sleeping.
+    while (1) {
+        pending = 0;
+        rtapi_list_for_each(ptr, &boards) {
+            litexcnc_eth_t *board = rtapi_list_entry(ptr, litexcnc_eth_t, list);
+            if (board->read_pending) {
+                poll_fds[pending].fd = eb_get_fd(board->connection);
+                poll_fds[pending].events = POLLIN;
+                poll_fds[pending].revents = 0;
+                poll_boards[pending] = board;
+                pending++;
+            }
+        }
+        uint64_t current = litexcnc_eth_time_ns();
+        if (!pending || (current >= deadline)) {
+            break;
+        }
+        struct timespec timeout = {
+            .tv_sec = busy_poll ? 0 : (deadline - current) / 1000000000ULL, 
+            .tv_nsec = busy_poll ? 0 : (deadline - current) % 1000000000ULL
+        };
+        if (ppoll(poll_fds, pending, &timeout, NULL) <= 0) {
+            continue;
+        }
+        // Process the boards which have received data
+        for (size_t i=0; i<pending; i++) {
+            if (poll_fds[i].revents & POLLIN) {
+                poll_boards[i]->read_deadline = deadline;
+                litexcnc_read_fpga(&poll_boards[i]->fpga, period);
+            }
+        }
+    }
+
+    // Process the remaining boards. The boards which did not respond in time keep their
+    // previous state. The boards with an I/O worker don't wait for a response.
+    for (size_t i=0; i<pending; i++) {
+        poll_boards[i]->read_pending = false;
+        poll_boards[i]->read_timed_out = true;
+        litexcnc_read_fpga(&poll_boards[i]->fpga, period);
+    }
+    rtapi_list_for_each(ptr, &boards) {
+        litexcnc_eth_t *board = rtapi_list_entry(ptr, litexcnc_eth_t, list);
+        if (!board->fpga.litexcnc->read_loop_has_run || board->read_timed_out || board->worker) {
+            litexcnc_read_fpga(&board->fpga, period);
+        }
+    }
+}
+
+
+static void litexcnc_eth_all_write(void *arg, long period) {
+    /*
+     * Writes the data to all boards. The packets of all boards are sent in a single
+     * batch, except for the boards with an I/O worker which send their own packets.
+     */
+    struct rtapi_list_head *ptr;
+    rtapi_list_for_each(ptr, &boards) {
+        litexcnc_eth_t *board = rtapi_list_entry(ptr, litexcnc_eth_t, list);
+        board->batch = !board->worker;
+        litexcnc_write_fpga(&board->fpga, period);
+    }
+    litexcnc_eth_send_batch();
+}
+
+
 static int litexcnc_post_register(litexcnc_fpga_t *this) {
     litexcnc_eth_t *board = this->private;
 
+    // Create a pin with the number of dropped responses
+    int r = hal_pin_u32_newf(HAL_OUT, &(board->hal.pin.stale_packets), this->comp_id, "%s.stale-packets", this->name);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s.stale-packets', aborting\n", this->name);
+        return r;
+    }
+
     // Create a pin to show debug messages
-    int r = hal_param_bit_newf(HAL_RW, &(board->hal.param.debug), this->comp_id, "%s.debug", this->name);
+    r = hal_param_bit_newf(HAL_RW, &(board->hal.param.debug), this->comp_id, "%s.debug", this->name);
     if (r < 0) {
         LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s.debug', aborting\n", this->name);
         return r;
     }
+
+    // Create a parameter to pipeline the read request with the write
+    r = hal_param_bit_newf(HAL_RW, &(board->hal.param.pipelined), this->comp_id, "%s.pipelined", this->name);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s.pipelined', aborting\n", this->name);
+        return r;
+    }
+
+    // Create parameters for the spacing of the packets
+    r = hal_param_u32_newf(HAL_RW, &(board->hal.param.tx_gap_ns), this->comp_id, "%s.tx-gap-ns", this->name);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s.tx-gap-ns', aborting\n", this->name);
+        return r;
+    }
+    board->hal.param.tx_gap_ns = EB_DEFAULT_TX_GAP_NS;
+    r = hal_param_bit_newf(HAL_RW, &(board->hal.param.tx_launch_time), this->comp_id, "%s.tx-launch-time", this->name);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s.tx-launch-time', aborting\n", this->name);
+        return r;
+    }
+
+    // Create a parameter for the number of writes after which all data is sent again
+    r = hal_param_u32_newf(HAL_RW, &(board->hal.param.write_refresh_period), this->comp_id, "%s.write-refresh-period", this->name);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s.write-refresh-period', aborting\n", this->name);
+        return r;
+    }
+    board->hal.param.write_refresh_period = LITEXCNC_ETH_DEFAULT_WRITE_REFRESH_PERIOD;
+
+    // Create parameters for waiting for the response
+    r = hal_param_float_newf(HAL_RW, &(board->hal.param.recv_deadline), this->comp_id, "%s.recv-deadline", this->name);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s.recv-deadline', aborting\n", this->name);
+        return r;
+    }
+    board->hal.param.recv_deadline = LITEXCNC_ETH_DEFAULT_RECV_DEADLINE;
+    r = hal_param_bit_newf(HAL_RW, &(board->hal.param.busy_poll), this->comp_id, "%s.busy-poll", this->name);
+    if (r < 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error adding pin '%s.busy-poll', aborting\n", this->name);
+        return r;
+    }
     
     return 0;
 }
@@ -340,13 +1189,69 @@ static int init_board(litexcnc_eth_t *board, const char *config_file) {
         LITEXCNC_ERR_NO_DEVICE("Missing required JSON key: '%s'\n", "ip_address");
         goto fail_without_disconnect;
     }
-    LITEXCNC_PRINT_NO_DEVICE("Connecting to board at address: %s:1234 \n", ip_address->valuestring);
-    board->connection = eb_connect(ip_address->valuestring, "1234", 1);
+    // Select the transport, default is UDP using the sockets of the kernel
+    const cJSON *transport = NULL;
+    transport = cJSON_GetObjectItemCaseSensitive(etherbone, "transport");
+    if (cJSON_IsString(transport) && (transport->valuestring != NULL) && (strcmp(transport->valuestring, "raw") == 0)) {
+        // Raw Ethernet frames, requires the interface and the MAC-address of the board
+        const cJSON *interface = NULL;
+        interface = cJSON_GetObjectItemCaseSensitive(etherbone, "interface");
+        if (!(cJSON_IsString(interface)) || (interface->valuestring == NULL)) {
+            LITEXCNC_ERR_NO_DEVICE("Missing required JSON key: '%s'\n", "interface");
+            goto fail_without_disconnect;
+        }
+        const cJSON *mac_address = NULL;
+        mac_address = cJSON_GetObjectItemCaseSensitive(etherbone, "mac_address");
+        if (!(cJSON_IsString(mac_address)) || (mac_address->valuestring == NULL)) {
+            LITEXCNC_ERR_NO_DEVICE("Missing required JSON key: '%s'\n", "mac_address");
+            goto fail_without_disconnect;
+        }
+        LITEXCNC_PRINT_NO_DEVICE("Connecting to board at address: %s:1234 (raw on %s)\n", ip_address->valuestring, interface->valuestring);
+        board->connection = eb_connect_raw(interface->valuestring, ip_address->valuestring, "1234", strtoull(mac_address->valuestring, NULL, 16));
+    } else if (cJSON_IsString(transport) && (transport->valuestring != NULL) && (strcmp(transport->valuestring, "xdp") == 0)) {
+        // Ethernet frames over AF_XDP, requires the interface and the MAC-address of the board
+        const cJSON *interface = NULL;
+        interface = cJSON_GetObjectItemCaseSensitive(etherbone, "interface");
+        if (!(cJSON_IsString(interface)) || (interface->valuestring == NULL)) {
+            LITEXCNC_ERR_NO_DEVICE("Missing required JSON key: '%s'\n", "interface");
+            goto fail_without_disconnect;
+        }
+        const cJSON *mac_address = NULL;
+        mac_address = cJSON_GetObjectItemCaseSensitive(etherbone, "mac_address");
+        if (!(cJSON_IsString(mac_address)) || (mac_address->valuestring == NULL)) {
+            LITEXCNC_ERR_NO_DEVICE("Missing required JSON key: '%s'\n", "mac_address");
+            goto fail_without_disconnect;
+        }
+        LITEXCNC_PRINT_NO_DEVICE("Connecting to board at address: %s:1234 (AF_XDP on %s)\n", ip_address->valuestring, interface->valuestring);
+        board->connection = eb_connect_xdp(interface->valuestring, ip_address->valuestring, "1234", strtoull(mac_address->valuestring, NULL, 16));
+        board->in_place = true;
+    } else if (cJSON_IsString(transport) && (transport->valuestring != NULL) && (strcmp(transport->valuestring, "udp") != 0)) {
+        LITEXCNC_ERR_NO_DEVICE("Unknown transport '%s'\n", transport->valuestring);
+        goto fail_without_disconnect;
+    } else {
+        LITEXCNC_PRINT_NO_DEVICE("Connecting to board at address: %s:1234 \n", ip_address->valuestring);
+        board->connection = eb_connect(ip_address->valuestring, "1234", 1);
+    }
     if (!board->connection) {
         rtapi_print_msg(RTAPI_MSG_ERR,"colorcnc: ERROR: failed to connect to board on ip-address '%s:1234'\n", ip_address->valuestring);
         goto fail_disconnect;
     }
 
+    // Optionally the communication is performed by a separate thread
+    bool use_worker = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(etherbone, "io_worker"));
+    int worker_cpu = -1;
+    int worker_priority = LITEXCNC_ETH_WORKER_DEFAULT_PRIORITY;
+    const cJSON *io_worker_cpu = NULL;
+    io_worker_cpu = cJSON_GetObjectItemCaseSensitive(etherbone, "io_worker_cpu");
+    if (cJSON_IsNumber(io_worker_cpu)) {
+        worker_cpu = io_worker_cpu->valueint;
+    }
+    const cJSON *io_worker_priority = NULL;
+    io_worker_priority = cJSON_GetObjectItemCaseSensitive(etherbone, "io_worker_priority");
+    if (cJSON_IsNumber(io_worker_priority)) {
+        worker_priority = io_worker_priority->valueint;
+    }
+
     // Continue process
     goto success_continue;
 
@@ -364,59 +1269,123 @@ success_continue:
     board->fpga.reset             = litexcnc_eth_reset;
     board->fpga.write_config      = litexcnc_eth_write_config;
     board->fpga.read              = litexcnc_eth_read;
-    board->fpga.read_header_size  = 16;
+    board->fpga.read_header_size  = LITEXCNC_ETH_HEADER_SIZE;
     board->fpga.write             = litexcnc_eth_write;
     board->fpga.write_header_size = 16;
+    board->fpga.write_footer_size = 4;
+    board->fpga.communicate       = litexcnc_eth_communicate;
     board->fpga.post_register     = litexcnc_post_register;
     board->fpga.private           = board;
 
     // Register the board with the main function
-    size_t ret = litexcnc_register(&board->fpga, config, fingerprint);
+    int ret = litexcnc_register(&board->fpga, config, fingerprint);
     if (ret != 0) {
         rtapi_print("board fails LitexCNC registration\n");
-        return ret;
+        goto fail_disconnect;
     }
     boards_count++;
 
     // Free memory (no need to read more data from the config file)
     cJSON_Delete(config);
 
-    // Set the header of the read and write buffer
+    // Set the header of the read and write buffer. The data is split over multiple
+    // packets when it doesn't fit in a single record.
     // WRITE BUFFER
-    memcpy(board->fpga.write_buffer, etherbone_header, sizeof(etherbone_header));
-    // - size
-    board->fpga.write_buffer[10] = (board->fpga.write_buffer_size - 16) >> 2; // Write count (in WORD-count, bitshift to divide by 4)
-    // - address
-    uint32_t address = htobe32(LITEXCNC_ETH_WRITE_DATA_BASE_ADDRESS(board->fpga));
-    memcpy(&board->fpga.write_buffer[12], &address, sizeof(address));
+    size_t write_words = (board->fpga.write_buffer_size - 16) >> 2;
+    board->write_chunks = (write_words + EB_MAX_RECORD_WORDS - 1) / EB_MAX_RECORD_WORDS;
+    board->write_chunk_headers = board->write_chunks > 1 ? rtapi_kmalloc((board->write_chunks - 1) << 4, RTAPI_GFP_KERNEL) : NULL;
+    for (size_t i=0; i<board->write_chunks; i++) {
+        uint8_t *header = i == 0 ? board->fpga.write_buffer : board->write_chunk_headers + ((i - 1) << 4);
+        memcpy(header, etherbone_header, sizeof(etherbone_header));
+        // - size
+        header[10] = litexcnc_eth_chunk_words(write_words, i); // Write count (in WORD-count)
+        // - address (the data is followed by the sequence number)
+        uint32_t address = htobe32(LITEXCNC_ETH_WRITE_DATA_BASE_ADDRESS(board->fpga) + ((i * EB_MAX_RECORD_WORDS) << 2));
+        memcpy(&header[12], &address, sizeof(address));
+    }
     // READ REQUEST BUFFER 
-    uint8_t *read_request_buffer = rtapi_kmalloc(board->fpga.read_buffer_size, RTAPI_GFP_KERNEL);
-    memcpy(read_request_buffer, etherbone_header, sizeof(etherbone_header));
-    // - size
-    size_t words = (board->fpga.read_buffer_size - 16) >> 2;
-    read_request_buffer[11] = words; // Write count (in WORD-count, bitshift to divide by 4)
-    // - addresses
-    uint32_t addresses[words];
-    for (size_t i=0; i<words; i++) {
-        addresses[i] = htobe32(LITEXCNC_ETH_READ_DATA_BASE_ADDRESS(board->fpga) + (i << 2));
-    }
-    memcpy(&read_request_buffer[16], addresses, words * 4);
-    // Store the created buffer
-    board->read_request_buffer = read_request_buffer;
+    // The data is read with burst reads (EB_FLAG_RFF): the request only contains the
+    // address of the first word, so the size of the request does not depend on the
+    // amount of data. The first request writes the sequence number and reads it back
+    // together with the data, as the sequence number is located directly before the
+    // data. The layout is: header, sequence number, return address and the address of
+    // the first word. The other requests only contain the header (including the return
+    // address) and the address of the first word.
+    size_t read_words = (board->fpga.read_buffer_size - 16) >> 2;
+    board->read_chunks = (read_words + EB_MAX_RECORD_WORDS - 1) / EB_MAX_RECORD_WORDS;
+    board->read_request_buffer_size = 8 + board->read_chunks * 20;
+    board->read_request_buffer = rtapi_kmalloc(board->read_request_buffer_size, RTAPI_GFP_KERNEL);
+    board->read_requests = rtapi_kmalloc(board->read_chunks * sizeof(struct iovec), RTAPI_GFP_KERNEL);
+    memset(board->read_request_buffer, 0, board->read_request_buffer_size);
+    uint8_t *request = board->read_request_buffer;
+    for (size_t i=0; i<board->read_chunks; i++) {
+        uint8_t *first = request + (i == 0 ? LITEXCNC_ETH_HEADER_SIZE + 4 : 16);
+        memcpy(request, etherbone_header, sizeof(etherbone_header));
+        request[8] = EB_FLAG_RFF;
+        // - size
+        request[11] = litexcnc_eth_chunk_words(read_words, i); // Read count (in WORD-count)
+        if (i == 0) {
+            uint32_t address = htobe32(LITEXCNC_ETH_SEQUENCE_ADDRESS(board->fpga));
+            request[10] = 1;  // Write count (the sequence number)
+            memcpy(&request[12], &address, sizeof(address));
+        }
+        // - address of the first word
+        uint32_t address = htobe32(LITEXCNC_ETH_SEQUENCE_ADDRESS(board->fpga) + ((i * EB_MAX_RECORD_WORDS) << 2));
+        memcpy(first, &address, sizeof(address));
+        board->read_requests[i].iov_base = request;
+        board->read_requests[i].iov_len = first + 4 - request;
+        request += board->read_requests[i].iov_len;
+    }
+    board->read_words = read_words;
+    // The first request is sent with the last packet of the data when it fits in a
+    // single Ethernet frame
+    board->read_attached = 
+        16 + (litexcnc_eth_chunk_words(write_words, board->write_chunks - 1) << 2) + 
+        board->read_requests[0].iov_len - LITEXCNC_ETH_HEADER_SIZE <= EB_MAX_PAYLOAD_SIZE;
+    // Copy of the data which changes only occasionally, the first write sends all data
+    board->write_shadow = rtapi_kmalloc(board->fpga.write_slow_size ? board->fpga.write_slow_size : 1, RTAPI_GFP_KERNEL);
+    board->write_refresh = true;
+    // Write and read in place in the frames of the transport (when supported). This is
+    // only possible when the data fits in a single packet and the buffers are not
+    // swapped with those of an I/O worker.
+    board->write_buffer_static = board->fpga.write_buffer;
+    board->read_buffer_static = board->fpga.read_buffer;
+    board->in_place = board->in_place && !use_worker && (board->write_chunks == 1) && (board->read_chunks == 1) && board->read_attached;
+    if (board->in_place) {
+        uint8_t *frame = eb_alloc_tx_buffer(board->connection);
+        if (frame) {
+            memcpy(frame, board->fpga.write_buffer, board->fpga.write_buffer_size);
+            board->fpga.write_buffer = frame;
+        }
+    }
+    if (use_worker && litexcnc_eth_start_worker(board, worker_cpu, worker_priority) < 0) {
+        eb_disconnect(&board->connection);
+        return -1;
+    }
     
     return 0;
 }
 
 
 static int close_board(litexcnc_eth_t *board) {
+    litexcnc_eth_stop_worker(board);
     eb_disconnect(&board->connection);
     return 0;
 }
 
 
+static void close_boards(void) {
+    struct rtapi_list_head *ptr;
+    rtapi_list_for_each(ptr, &boards) {
+        close_board(rtapi_list_entry(ptr, litexcnc_eth_t, list));
+    }
+}
+
+
 int rtapi_app_main(void) {
     RTAPI_INIT_LIST_HEAD(&ifnames);
     RTAPI_INIT_LIST_HEAD(&board_num);
+    RTAPI_INIT_LIST_HEAD(&boards);
 
     int ret, i;
 
@@ -431,9 +1400,36 @@ int rtapi_app_main(void) {
 
     // STEP 2: Initialize the board(s)
     for(i = 0, ret = 0; ret == 0 && i<MAX_ETH_BOARDS && config_file[i] && *config_file[i]; i++) {
-        boards[i] = (litexcnc_eth_t *)hal_malloc(sizeof(litexcnc_eth_t));
-        ret = init_board(boards[i], config_file[i]);
+        litexcnc_eth_t *board = (litexcnc_eth_t *)hal_malloc(sizeof(litexcnc_eth_t));
+        memset(board, 0, sizeof(litexcnc_eth_t));
+        ret = init_board(board, config_file[i]);
         if(ret < 0) goto error;
+        rtapi_list_add_tail(&board->list, &boards);
+    }
+
+    if (boards_count == 0) {
+        LITEXCNC_ERR_NO_DEVICE("No boards configured, aborting\n");
+        ret = -ENODEV;
+        goto error;
+    }
+
+    // STEP 3: Export the functions which serve all boards at once
+    poll_fds = rtapi_kmalloc(boards_count * sizeof(struct pollfd), RTAPI_GFP_KERNEL);
+    poll_boards = rtapi_kmalloc(boards_count * sizeof(litexcnc_eth_t *), RTAPI_GFP_KERNEL);
+    if (poll_fds == NULL || poll_boards == NULL) {
+        LITEXCNC_ERR_NO_DEVICE("out of memory!\n");
+        ret = -ENOMEM;
+        goto error;
+    }
+    ret = hal_export_funct(LITEXCNC_ETH_NAME ".all.read", litexcnc_eth_all_read, NULL, 1, 0, comp_id);
+    if (ret != 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error exporting function '%s', aborting\n", LITEXCNC_ETH_NAME ".all.read");
+        goto error;
+    }
+    ret = hal_export_funct(LITEXCNC_ETH_NAME ".all.write", litexcnc_eth_all_write, NULL, 1, 0, comp_id);
+    if (ret != 0) {
+        LITEXCNC_ERR_NO_DEVICE("Error exporting function '%s', aborting\n", LITEXCNC_ETH_NAME ".all.write");
+        goto error;
     }
 
     // Report the board as ready
@@ -442,9 +1438,10 @@ int rtapi_app_main(void) {
 
 error:
     // Close all the boards
-    for(i = 0; i<MAX_ETH_BOARDS && config_file[i] && config_file[i][0]; i++)
-        close_board(boards[i]);
+    close_boards();
     // Free up the used memory
+    if (poll_fds != NULL) rtapi_kfree(poll_fds);
+    if (poll_boards != NULL) rtapi_kfree(poll_boards);
     dict_free(&board_num);
     dict_free(&ifnames);
     // Report the board as unloaded
@@ -455,9 +1452,10 @@ error:
 
 void rtapi_app_exit(void) {
     // Close all the boards
-    for(int i = 0; i<MAX_ETH_BOARDS && config_file[i] && config_file[i][0]; i++)
-        close_board(boards[i]);
+    close_boards();
     // Free up the used memory
+    if (poll_fds != NULL) rtapi_kfree(poll_fds);
+    if (poll_boards != NULL) rtapi_kfree(poll_boards);
     dict_free(&board_num);
     dict_free(&ifnames);
     // Report the board as unloaded
@@ -467,5 +1465,7 @@ void rtapi_app_exit(void) {
 
 
 // Include other c-files, because LinuxCNC Makefile cannot handle loose files
+#include "etherbone_raw.c"
+#include "etherbone_xdp.c"
 #include "etherbone.c"
 #include "cJSON/cJSON.c"
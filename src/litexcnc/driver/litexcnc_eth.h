@@ -20,16 +20,55 @@
 
 #define LITEXCNC_ETH_NAME    "litexcnc_eth"
 #define LITEXCNC_ETH_VERSION "0.02"
-#define MAX_ETH_BOARDS 4
+#define MAX_ETH_BOARDS 16  // Only limits the number of config files, the boards are allocated dynamically
 #define MAX_RESET_RETRIES 5
 
+#include <pthread.h>
+#include <semaphore.h>
+#include <rtapi_list.h>
+
 #include "etherbone.h"
 
+// The number of buffers of a packet which can be queued for sending in a batch
+#define LITEXCNC_ETH_BATCH_IOV 3
+
+// The default real-time priority of the I/O worker (SCHED_FIFO)
+#define LITEXCNC_ETH_WORKER_DEFAULT_PRIORITY 80
+
+typedef struct {
+    pthread_t thread;
+    sem_t wakeup;  // Posted by the HAL thread when a request is made
+    bool stop;
+    // Copy of the FPGA with the buffers used by the worker for the communication. The
+    // HAL thread has its own buffers, which are swapped with those of the worker when
+    // a request is made (write) and when its response is picked up (read).
+    litexcnc_fpga_t fpga;
+    // Hand-off between the HAL thread (producer of the requests) and the worker (producer
+    // of the responses). The HAL thread makes a request by incrementing `posted`, the
+    // worker sets `done` to the same number when it has finished. The buffers of the
+    // worker are only accessed by the HAL thread when `done` equals `posted`.
+    uint32_t posted;
+    uint32_t done;
+    uint32_t consumed;  // The last request of which the response has been used
+    bool write;         // The request contains data, otherwise only the status is read
+    long period;
+    int result;
+} litexcnc_eth_worker_t;
+
 typedef struct {
 
     struct {
         struct {
-            hal_bit_t debug;  // Indicates the communication is in debug mode
+            hal_u32_t *stale_packets;  // Number of late responses which have been dropped
+        } pin;
+        struct {
+            hal_bit_t debug;      // Indicates the communication is in debug mode
+            hal_bit_t pipelined;  // Sends the read request for the next period with the write
+            hal_u32_t tx_gap_ns;  // Minimum time between two packets sent to the board
+            hal_bit_t tx_launch_time;  // Use the launch time of the kernel (SO_TXTIME, requires ETF qdisc)
+            hal_u32_t write_refresh_period;  // Number of writes after which all data is sent again
+            hal_float_t recv_deadline;  // Time to wait for a response, as fraction of the period
+            hal_bit_t busy_poll;        // Spin while waiting for a response (for isolated cores)
         } param;
     } hal;
 
@@ -40,15 +79,72 @@ typedef struct {
     uint8_t *read_request_buffer;
     size_t read_request_header_size;
     size_t read_request_buffer_size;
+    // Large configurations do not fit in a single record (at most EB_MAX_RECORD_WORDS
+    // words), the data is then split over multiple packets.
+    size_t write_chunks;           // Number of packets with data
+    uint8_t *write_chunk_headers;  // Headers of the packets with data, except the first (in the write buffer)
+    size_t read_chunks;            // Number of requests for data
+    size_t read_words;             // Number of words requested (including the sequence number)
+    struct iovec *read_requests;   // The requests in the read request buffer
+    bool read_attached;            // The first request fits in the last packet with data
+    // Indicates the read request has been sent, either with the write (pipelined mode)
+    // or by the function serving all boards. The lag is the number of periods the data
+    // lags behind when it is received.
+    bool read_pending;
+    uint8_t read_pending_lag;
+    // No response has been received before the deadline of the function serving all boards
+    bool read_timed_out;
+    // The deadline for receiving the response, when set by the function serving all
+    // boards (CLOCK_MONOTONIC, in nanoseconds). Zero when the read sets its own deadline.
+    uint64_t read_deadline;
+    // When set, the next packet is queued instead of sent, so the packets of all boards
+    // can be sent in a single batch (see `litexcnc_eth_all_read`).
+    bool batch;
+    struct iovec batch_iov[LITEXCNC_ETH_BATCH_IOV];
+    int batch_iovcnt;
+    uint8_t batch_header[32];  // Copy of the first buffer, which can be located on the stack
+    // Sequence number of the last request for data. The number is written to the FPGA
+    // in the same record as the request, the FPGA echoes it in the response.
+    uint32_t sequence;
+    // Copy of the data which changes only occasionally as last sent to the FPGA. Only
+    // the data starting from the first word which differs from this copy is sent.
+    uint8_t *write_shadow;
+    uint32_t writes_since_refresh;
+    bool write_refresh;  // Send all data with the next write (start-up, after a failure)
+
+    // When the transport supports it (AF_XDP), the write buffer and the read buffer of
+    // the FPGA point to the frames of the transport, so the data is written and read in
+    // place. The buffers allocated by the driver are kept as fall-back.
+    bool in_place;
+    uint8_t *write_buffer_static;
+    uint8_t *read_buffer_static;
+    uint8_t *rx_frame;
+
+    // When set, the communication is performed by a separate thread and the functions of
+    // the HAL thread don't perform any system calls (see `litexcnc_eth_worker_read`)
+    litexcnc_eth_worker_t *worker;
 
     // Definition of the FPGA (containing pins, steppers, PWM, ec.)
     litexcnc_fpga_t fpga;
+
+    struct rtapi_list_head list;
 } litexcnc_eth_t;
 
+// The header of the read buffer consists of the Etherbone header (16 bytes) and the
+// sequence number (4 bytes). The same holds for the request for data. In the write buffer
+// the sequence number is written after the data.
+#define LITEXCNC_ETH_HEADER_SIZE 20
+
+// By default all data is sent to the FPGA once per this number of writes
+#define LITEXCNC_ETH_DEFAULT_WRITE_REFRESH_PERIOD 1000
+// By default the response is awaited for at most this fraction of the period
+#define LITEXCNC_ETH_DEFAULT_RECV_DEADLINE 0.5
+
 #define LITEXCNC_ETH_INIT_DATA_BASE_ADDRESS(fpga)    0x0
 #define LITEXCNC_ETH_RESET_DATA_BASE_ADDRESS(fpga)   LITEXCNC_ETH_INIT_DATA_BASE_ADDRESS(fpga) + LITEXCNC_HEADER_DATA_READ_SIZE
 #define LITEXCNC_ETH_CONFIG_DATA_BASE_ADDRESS(fpga)  LITEXCNC_ETH_RESET_DATA_BASE_ADDRESS(fpga) + LITEXCNC_RESET_HEADER_SIZE
-#define LITEXCNC_ETH_WRITE_DATA_BASE_ADDRESS(fpga)   LITEXCNC_ETH_CONFIG_DATA_BASE_ADDRESS(fpga) + LITEXCNC_CONFIG_HEADER_SIZE
+#define LITEXCNC_ETH_WRITE_DATA_BASE_ADDRESS(fpga)   LITEXCNC_ETH_CONFIG_DATA_BASE_ADDRESS(fpga) + fpga.config_size
 #define LITEXCNC_ETH_READ_DATA_BASE_ADDRESS(fpga)    LITEXCNC_ETH_WRITE_DATA_BASE_ADDRESS(fpga) + fpga.write_buffer_size - fpga.write_header_size
+#define LITEXCNC_ETH_SEQUENCE_ADDRESS(fpga)          LITEXCNC_ETH_READ_DATA_BASE_ADDRESS(fpga) - fpga.write_footer_size
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
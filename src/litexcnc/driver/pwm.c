@@ -159,122 +159,117 @@ fail_pins:
 }
 
 
-uint8_t litexcnc_pwm_prepare_write(litexcnc_t *litexcnc, uint8_t **data) {
-    // This function translarte the input of the PWM component to:
-    // - enable (Signal(): 1-bit unsigned integer / boolean, but stored in a 32-bit wide format)
-    // - period (Signal(32): 32-bit unsigned integer)
-    // - width  (Signal(32): 32-bit unsigned integer)
-    static double duty_cycle;
+static void litexcnc_pwm_calculate(litexcnc_t *litexcnc, litexcnc_pwm_pin_t *instance) {
+    /**
+    This code is based on the original pwmgen.c code by John Kasunich. Original source code
+    can be found here: 
+        https://github.com/LinuxCNC/linuxcnc/blob/9e28b3d8fe23fff0e08fc0f8d232c96be04404a6/src/hal/components/pwmgen.c
+    
+    The code by John Kasunich is licensed under GPL v2.0.
 
-    // Process enable signal
-    static uint8_t mask;
-    mask = 0x80;
-    for (size_t i=LITEXCNC_PWM_ENABLE_DATA_WRITE_SIZE(litexcnc)*8; i>0; i--) {
-        // The counter i can have a value outside the range of possible pins. We only
-        // should add data from existing pins
-        if (i <= litexcnc->pwm.num_instances) {
-            *(*data) |= (*(litexcnc->pwm.instances[i-1].hal.pin.enable))?mask:0;
-        }
-        // Modify the mask for the next. When the mask is zero (happens in case of a 
-        // roll-over), we should proceed to the next byte and reset the mask.
-        mask >>= 1;
-        if (!mask) {
-            mask = 0x80;  // Reset the mask
-            (*data)++; // Proceed the buffer to the next element
-        }
+    Changes made with respect to the original code:
+        - change variable names to connect to the structs of LiteX-CNC;
+        - print message when parameters are out of bound and thus modified;
+        - the PWM is generated in hardware, therefore the calculation of the period is modified, as
+          this uses the frequency of the board.
+    */
+    // Validate duty cycle limits, both limits must be between 0.0 and 1.0 (inclusive) 
+    // and max must be greater then min
+    if ( *(instance->hal.pin.max_dc) > 1.0 ) {
+        *(instance->hal.pin.max_dc) = 1.0;
+        // TODO: print message
+    }
+    if ( *(instance->hal.pin.min_dc) > *(instance->hal.pin.max_dc) ) {
+        *(instance->hal.pin.min_dc) = *(instance->hal.pin.max_dc);
+        // TODO: print message
+    }
+    if ( *(instance->hal.pin.min_dc) < 0.0 ) {
+        *(instance->hal.pin.min_dc) = 0.0;
+        // TODO: print message
+    }
+    if ( *(instance->hal.pin.max_dc) < *(instance->hal.pin.min_dc) ) {
+        *(instance->hal.pin.max_dc) = *(instance->hal.pin.min_dc);
+        // TODO: print message
     }
 
-    // Process all instances
-    for (size_t i=0; i < litexcnc->pwm.num_instances; i++) {
-        /**
-        This code is based on the original pwmgen.c code by John Kasunich. Original source code
-        can be found here: 
-            https://github.com/LinuxCNC/linuxcnc/blob/9e28b3d8fe23fff0e08fc0f8d232c96be04404a6/src/hal/components/pwmgen.c
-        
-        The code by John Kasunich is licensed under GPL v2.0.
+    // Validate the scale (prevent division by zero) and calculate its reciprocal
+    if ((*(instance->hal.pin.scale) < 1e-20) && (*(instance->hal.pin.scale) > -1e-20)) {
+        *(instance->hal.pin.scale) = 1.0;
+        // TODO: print message
+    }
+    instance->hal.param.scale_recip = 1.0 / *(instance->hal.pin.scale);
 
-        Changes made with respect to the original code:
-            - change variable names to connect to the structs of LiteX-CNC;
-            - print message when parameters are out of bound and thus modified;
-            - the PWM is generated in hardware, therefore the calculation of the period is modified, as
-              this uses the frequency of the board.
-        */
-        // Get pointer to the pwmgen instance
-        litexcnc_pwm_pin_t *instance = &(litexcnc->pwm.instances[i]);
+    // Calculate the duty cycle
+    // - convert value command to duty cycle
+    double duty_cycle = *(instance->hal.pin.value) * instance->hal.param.scale_recip + *(instance->hal.pin.offset);
+    // - unidirectional mode, no negative output
+    if ( duty_cycle < 0.0 ) {
+        duty_cycle = 0.0;
+    }
+    // - limit the duty-cylce 
+    if ( duty_cycle > *(instance->hal.pin.max_dc) ) {
+        duty_cycle = *(instance->hal.pin.max_dc);
+    } else if ( duty_cycle < *(instance->hal.pin.min_dc) ) {
+        duty_cycle = *(instance->hal.pin.min_dc);
+    }
 
-        // Validate duty cycle limits, both limits must be between 0.0 and 1.0 (inclusive) 
-        // and max must be greater then min
-        if ( *(instance->hal.pin.max_dc) > 1.0 ) {
-            *(instance->hal.pin.max_dc) = *(instance->hal.pin.max_dc);
-            // TODO: print message
-        }
-        if ( *(instance->hal.pin.min_dc) > *(instance->hal.pin.max_dc) ) {
-            *(instance->hal.pin.min_dc) = *(instance->hal.pin.max_dc);
-            // TODO: print message
-        }
-        if ( *(instance->hal.pin.min_dc) < 0.0 ) {
-            *(instance->hal.pin.min_dc) = 0.0;
+    if (*(instance->hal.pin.pwm_freq) != 0) {
+        // PWM mode
+        if ( *(instance->hal.pin.pwm_freq) < 1.0 ) {
+            *(instance->hal.pin.pwm_freq) = 1.0;
             // TODO: print message
         }
-        if ( *(instance->hal.pin.max_dc) < *(instance->hal.pin.min_dc) ) {
-            *(instance->hal.pin.max_dc) = *(instance->hal.pin.min_dc);
-            // TODO: print message
+        *(instance->hal.pin.curr_period) = (litexcnc->clock_frequency / *(instance->hal.pin.pwm_freq)) + 0.5;
+        instance->hal.param.period_recip = 1.0 / *(instance->hal.pin.curr_period);
+        // - convert duty-cycle to period -> round to the nearest duty cycle
+        *(instance->hal.pin.curr_width) = (*(instance->hal.pin.curr_period) * duty_cycle) + 0.5;
+        // - save rounded value to curr_dc pin
+        if ( duty_cycle >= 0 ) {
+            *(instance->hal.pin.curr_dc) = *(instance->hal.pin.curr_width) * instance->hal.param.period_recip;
+        } else {
+            *(instance->hal.pin.curr_dc) = -*(instance->hal.pin.curr_width) * instance->hal.param.period_recip;
         }
+    } else {
+        // PDM mode
+        *(instance->hal.pin.curr_period) = 0;
+        // In PDM mode, the duty cycle is store as a 16-bit integer which is send as the width
+        *(instance->hal.pin.curr_width) = (0xFFFF * duty_cycle);
+    }
+}
 
-        // Scale calculations only required when scale changes
-        if ( *(instance->hal.pin.scale) != instance->memo.scale ) {
-            // Store value to detect future scale changes
-            instance->memo.scale = *(instance->hal.pin.scale);
-            // Validate new value (prevent division by zero)
-            if ((*(instance->hal.pin.scale) < 1e-20) && (*(instance->hal.pin.scale) > -1e-20)) {
-                *(instance->hal.pin.scale) = 1.0;
-                // TODO: print message
-            }
-            // Calculate the reciprocal of the scalle
-            instance->hal.param.scale_recip = 1.0 / *(instance->hal.pin.scale);
-	    }
 
-        // Calculate the duty cycle
-        // - convert value command to duty cycle
-        duty_cycle = *(instance->hal.pin.value) * instance->hal.param.scale_recip + *(instance->hal.pin.offset);
-        // - unidirectional mode, no negative output
-        if ( duty_cycle < 0.0 ) {
-            duty_cycle = 0.0;
-        }
-        // - limit the duty-cylce 
-        if ( duty_cycle > *(instance->hal.pin.max_dc) ) {
-            duty_cycle = *(instance->hal.pin.max_dc);
-        } else if ( duty_cycle < *(instance->hal.pin.min_dc) ) {
-            duty_cycle = *(instance->hal.pin.min_dc);
+uint8_t litexcnc_pwm_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period) {
+    // This function translarte the input of the PWM component to:
+    // - enable (Signal(): 1-bit unsigned integer / boolean, but stored in a 32-bit wide format)
+    // - period (Signal(32): 32-bit unsigned integer)
+    // - width  (Signal(32): 32-bit unsigned integer)
+
+    // Process enable signal, a word at a time (see `litexcnc_flag_write`)
+    for (size_t word=0; word<litexcnc_flag_words(litexcnc->pwm.num_instances); word++) {
+        litexcnc_pwm_pin_t *instances = &litexcnc->pwm.instances[litexcnc_flag_first(litexcnc->pwm.num_instances, word)];
+        size_t count = litexcnc_flag_count(litexcnc->pwm.num_instances, word);
+        uint32_t flags = 0;
+        for (size_t i=0; i<count; i++) {
+            flags |= (uint32_t) (*(instances[i].hal.pin.enable) != 0) << i;
         }
+        litexcnc_flag_write(data, flags);
+    }
 
-        if (*(instance->hal.pin.pwm_freq) != 0) {
-            // PWM mode
-            // - recalculate period only required when pwm_freq changes
-            if ( *(instance->hal.pin.pwm_freq) < 1.0 ) {
-                *(instance->hal.pin.pwm_freq) = 1.0;
-                // TODO: print message
-            }
-            if ( *(instance->hal.pin.pwm_freq) != instance->memo.pwm_freq ) {
-                // Store value to detect future scale changes
-                instance->memo.scale = *(instance->hal.pin.scale);
-                // Calculate the new width
-                *(instance->hal.pin.curr_period) = (litexcnc->clock_frequency / *(instance->hal.pin.pwm_freq)) + 0.5;
-                instance->hal.param.period_recip = 1.0 / *(instance->hal.pin.curr_period);
-            }
-            // - convert duty-cycle to period -> round to the nearest duty cycle
-            *(instance->hal.pin.curr_width) = (*(instance->hal.pin.curr_period) * duty_cycle) + 0.5;
-            // - save rounded value to curr_dc pin
-            if ( duty_cycle >= 0 ) {
-                *(instance->hal.pin.curr_dc) = *(instance->hal.pin.curr_width) * instance->hal.param.period_recip;
-            } else {
-                *(instance->hal.pin.curr_dc) = -*(instance->hal.pin.curr_width) * instance->hal.param.period_recip;
-            }
-        } else {
-            // PDM mode
-            *(instance->hal.pin.curr_period) = 0;
-            // In PDM mode, the duty cycle is store as a 16-bit integer which is send as the width
-            *(instance->hal.pin.curr_width) = (0xFFFF * duty_cycle);
+    // Process all instances. The period and width are only recalculated when one of the
+    // inputs of the instance has changed.
+    for (size_t i=0; i < litexcnc->pwm.num_instances; i++) {
+        // Get pointer to the pwmgen instance
+        litexcnc_pwm_pin_t *instance = &(litexcnc->pwm.instances[i]);
+        litexcnc_pwm_inputs_t inputs = {
+            .value    = *(instance->hal.pin.value),
+            .scale    = *(instance->hal.pin.scale),
+            .offset   = *(instance->hal.pin.offset),
+            .pwm_freq = *(instance->hal.pin.pwm_freq),
+            .min_dc   = *(instance->hal.pin.min_dc),
+            .max_dc   = *(instance->hal.pin.max_dc),
+        };
+        if (LITEXCNC_INPUTS_CHANGED(instance->memo, inputs)) {
+            litexcnc_pwm_calculate(litexcnc, instance);
         }
 
         // Add the PWM generator to the data
@@ -290,8 +285,24 @@ uint8_t litexcnc_pwm_prepare_write(litexcnc_t *litexcnc, uint8_t **data) {
     return 0;
 }
 
-uint8_t litexcnc_pwm_process_read(litexcnc_t *litexcnc, uint8_t **data) {
+uint8_t litexcnc_pwm_process_read(litexcnc_t *litexcnc, uint8_t **data, long period) {
     // This function is deliberately empty as no data is read back from the board
     // to the HAL component.
     return 0;
 }
+
+
+static size_t litexcnc_pwm_write_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_BOARD_PWM_DATA_WRITE_SIZE(litexcnc);
+}
+
+
+// Description of the module for the LitexCNC driver (see `litexcnc_module_t`)
+const litexcnc_module_t litexcnc_pwm_module = {
+    .name = "PWM",
+    .init = litexcnc_pwm_init,
+    .prepare_write = litexcnc_pwm_prepare_write,
+    .write_size = litexcnc_pwm_write_size,
+    .write_slow = true,
+    .slow_rate = true,
+};
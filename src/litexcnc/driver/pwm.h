@@ -39,6 +39,17 @@
 
 #include "cJSON/cJSON.h"
 
+// The inputs of a PWM instance from which the period and width are derived (see
+// `litexcnc_inputs_changed`)
+typedef struct {
+    hal_float_t value;
+    hal_float_t scale;
+    hal_float_t offset;
+    hal_float_t pwm_freq;
+    hal_float_t min_dc;
+    hal_float_t max_dc;
+} litexcnc_pwm_inputs_t;
+
 // Defines the structure of the PWM instance
 typedef struct {
     struct {
@@ -67,8 +78,8 @@ typedef struct {
 
     // This struct holds all old values (memoization) 
     struct {
-        double scale;
-        double pwm_freq;
+        litexcnc_pwm_inputs_t inputs;
+        bool inputs_valid;
     } memo;
     
 } litexcnc_pwm_pin_t;
@@ -102,7 +113,8 @@ typedef struct {
 // Functions for creating, reading and writing PWM pins
 int litexcnc_pwm_init(litexcnc_t *litexcnc, cJSON *config);
 uint8_t litexcnc_pwm_config(litexcnc_t *litexcnc, uint8_t **data, long period);
-uint8_t litexcnc_pwm_prepare_write(litexcnc_t *litexcnc, uint8_t **data);
-uint8_t litexcnc_pwm_process_read(litexcnc_t *litexcnc, uint8_t** data);
+uint8_t litexcnc_pwm_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period);
+uint8_t litexcnc_pwm_process_read(litexcnc_t *litexcnc, uint8_t** data, long period);
+extern const litexcnc_module_t litexcnc_pwm_module;
 
 #endif
\ No newline at end of file
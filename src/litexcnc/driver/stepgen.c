@@ -41,6 +41,29 @@
 
 #include "stepgen.h"
 
+static int litexcnc_stepgen_alloc_state(litexcnc_stepgen_state_t *state, size_t num_instances) {
+    // Allocates the arrays with the data used each period (see `litexcnc_stepgen_state_t`)
+#define LITEXCNC_STEPGEN_ALLOC_STATE(field) \
+    state->field = (void *) litexcnc_alloc_buffer(num_instances * sizeof(*state->field)); \
+    if (state->field == NULL) { return -1; }
+    LITEXCNC_STEPGEN_ALLOC_STATE(position)
+    LITEXCNC_STEPGEN_ALLOC_STATE(scale_recip)
+    LITEXCNC_STEPGEN_ALLOC_STATE(fpga_pos_scale_inv)
+    LITEXCNC_STEPGEN_ALLOC_STATE(fpga_speed_scale_inv)
+    LITEXCNC_STEPGEN_ALLOC_STATE(position_fb)
+    LITEXCNC_STEPGEN_ALLOC_STATE(speed_fb)
+    LITEXCNC_STEPGEN_ALLOC_STATE(position_prediction)
+    LITEXCNC_STEPGEN_ALLOC_STATE(speed_prediction)
+    LITEXCNC_STEPGEN_ALLOC_STATE(flt_speed)
+    LITEXCNC_STEPGEN_ALLOC_STATE(flt_acc_recip)
+    LITEXCNC_STEPGEN_ALLOC_STATE(fpga_speed)
+    LITEXCNC_STEPGEN_ALLOC_STATE(fpga_acc)
+    LITEXCNC_STEPGEN_ALLOC_STATE(fpga_time)
+#undef LITEXCNC_STEPGEN_ALLOC_STATE
+    return 0;
+}
+
+
 int litexcnc_stepgen_init(litexcnc_t *litexcnc, cJSON *config) {
 
     // Declarations
@@ -49,6 +72,8 @@ int litexcnc_stepgen_init(litexcnc_t *litexcnc, cJSON *config) {
     const cJSON *stepgen_config = NULL;
     const cJSON *stepgen_instance_config = NULL;
     const cJSON *stepgen_instance_name = NULL;
+    const cJSON *stepgen_instance_max_frequency = NULL;
+    const cJSON *stepgen_instance_step_mode = NULL;
     char base_name[HAL_NAME_LEN + 1];   // i.e. <board_name>.<board_index>.stepgen.<stepgen_name>
     char name[HAL_NAME_LEN + 1];        // i.e. <base_name>.<pin_name>
 
@@ -70,12 +95,9 @@ int litexcnc_stepgen_init(litexcnc_t *litexcnc, cJSON *config) {
     rtapi_snprintf(name, sizeof(name), "%s.stepgen.period-s-recip", litexcnc->fpga->name);
     r = hal_pin_float_new(name, HAL_OUT, &(litexcnc->stepgen.hal->pin.period_s_recip), litexcnc->fpga->comp_id);
     if (r != 0) { goto fail_pins; }
-    // - the maximum frequency of the drivers
-    rtapi_snprintf(name, sizeof(name), "%s.stepgen.max-driver-freq", litexcnc->fpga->name);
-    r = hal_param_float_new(name, HAL_OUT, &(litexcnc->stepgen.hal->param.max_driver_freq), litexcnc->fpga->comp_id);
-    if (r != 0) { goto fail_pins; }
-    // set the default value
-    litexcnc->stepgen.hal->param.max_driver_freq = 400e3;
+
+    // The pick-off of the position is the same for all instances
+    litexcnc->stepgen.data.pick_off_pos = 32;
     
     // Parse the contents of the config-json
     stepgen_config = cJSON_GetObjectItemCaseSensitive(config, "stepgen");
@@ -91,6 +113,11 @@ int litexcnc_stepgen_init(litexcnc_t *litexcnc, cJSON *config) {
             r = -ENOMEM;
             return r;
         }
+        if (litexcnc->stepgen.num_instances && (litexcnc_stepgen_alloc_state(&litexcnc->stepgen.state, litexcnc->stepgen.num_instances) < 0)) {
+            LITEXCNC_ERR_NO_DEVICE("Out of memory!\n");
+            r = -ENOMEM;
+            return r;
+        }
 
         // Create the pins and params in the HAL
         i = 0;
@@ -106,7 +133,42 @@ int litexcnc_stepgen_init(litexcnc_t *litexcnc, cJSON *config) {
                 rtapi_snprintf(base_name, sizeof(base_name), "%s.stepgen.%02zu", litexcnc->fpga->name, i);
             }
 
+            // Read the step mode. In toggle mode each edge of the step pin is a step.
+            stepgen_instance_step_mode = cJSON_GetObjectItemCaseSensitive(stepgen_instance_config, "step_mode");
+            instance->data.toggle_step = cJSON_IsString(stepgen_instance_step_mode) && (strcmp(stepgen_instance_step_mode->valuestring, "toggle") == 0);
+
+            // Determine the pick-offs of speed and acceleration from the maximum frequency
+            // of the driver. The shift is the smallest shift for which the maximum speed of
+            // the FPGA does not exceed the maximum step rate, which is twice the maximum
+            // frequency in toggle mode. The firmware uses the same formula (see
+            // `StepgenConfig.pick_off`).
+            double max_frequency = STEPGEN_DEFAULT_MAX_FREQUENCY;
+            stepgen_instance_max_frequency = cJSON_GetObjectItemCaseSensitive(stepgen_instance_config, "max_frequency");
+            if (cJSON_IsNumber(stepgen_instance_max_frequency)) {
+                max_frequency = stepgen_instance_max_frequency->valuedouble;
+            }
+            if (!(max_frequency > 0)) {
+                LITEXCNC_ERR_NO_DEVICE("Invalid value for 'max_frequency' of '%s'\n", base_name);
+                r = -EINVAL;
+                return r;
+            }
+            double max_step_rate = max_frequency * (instance->data.toggle_step ? 2 : 1);
+            size_t shift = 0;
+            while (litexcnc->clock_frequency / (double) (1ULL << (shift + 1)) > max_step_rate)
+                shift += 1;
+            instance->data.pick_off_vel = litexcnc->stepgen.data.pick_off_pos + shift;
+            instance->data.pick_off_acc = instance->data.pick_off_vel + 8;
+
             // Create the params
+            // - Maximum frequency of the driver
+            rtapi_snprintf(name, sizeof(name), "%s.max-driver-freq", base_name); 
+            r = hal_param_float_new(name, HAL_RO, &(instance->hal.param.max_driver_freq), litexcnc->fpga->comp_id);
+            if (r < 0) { goto fail_params; }
+            instance->hal.param.max_driver_freq = max_frequency;
+            // - Maximum step rate (calculated when the FPGA is configured)
+            rtapi_snprintf(name, sizeof(name), "%s.max-frequency", base_name); 
+            r = hal_param_float_new(name, HAL_RO, &(instance->hal.param.max_frequency), litexcnc->fpga->comp_id);
+            if (r < 0) { goto fail_params; }
             // - Frequency
             rtapi_snprintf(name, sizeof(name), "%s.frequency", base_name); 
             r = hal_param_float_new(name, HAL_RO, &(instance->hal.param.frequency), litexcnc->fpga->comp_id);
@@ -202,37 +264,23 @@ uint8_t litexcnc_stepgen_config(litexcnc_t *litexcnc, uint8_t **data, long perio
     *(litexcnc->stepgen.hal->pin.period_s) = 1e-9 * period;
     *(litexcnc->stepgen.hal->pin.period_s_recip) = 1.0f / *(litexcnc->stepgen.hal->pin.period_s);
     litexcnc->stepgen.memo.cycles_per_period = *(litexcnc->stepgen.hal->pin.period_s) * litexcnc->clock_frequency;
-    // Initialize the running average
+    // Initialize the running average (the configuration is repeated when the link with
+    // the FPGA is recovered)
+    litexcnc->stepgen.data.wallclock_buffer_sum = 0;
+    litexcnc->stepgen.data.wallclock_buffer_pos = 0;
     for (size_t i=0; i<STEPGEN_WALLCLOCK_BUFFER; i++){
         litexcnc->stepgen.data.wallclock_buffer[i] = (double) *(litexcnc->stepgen.hal->pin.period_s);
         litexcnc->stepgen.data.wallclock_buffer_sum += *(litexcnc->stepgen.hal->pin.period_s);
     }
 
-    // Set the pick-offs. At this moment it is fixed, but is easy to make it configurable
-    int8_t shift = 0;
-    while (litexcnc->clock_frequency / (1 << (shift + 1)) > litexcnc->stepgen.hal->param.max_driver_freq)
-        shift += 1;
-    litexcnc->stepgen.data.pick_off_pos = 32;
-    litexcnc->stepgen.data.pick_off_vel = litexcnc->stepgen.data.pick_off_pos + shift;
-    litexcnc->stepgen.data.pick_off_acc = litexcnc->stepgen.data.pick_off_vel + 8;
-    litexcnc->stepgen.data.max_frequency = (float) litexcnc->clock_frequency / (1 << (shift + 1));
-
     // Timings
     // ===============
-    // All stepgens will use the same values for steplen, dir_hold_time and dir_setup_time.
-    // The maximum value is governing, so we start with the value 0. For each instance
-    // it is checked whether the value has changed. If it has changed, the time is
-    // converted to cycles.
+    // Each stepgen has its own timings for steplen, dir_hold_time and dir_setup_time,
+    // which are converted to cycles and sent to the FPGA.
     // NOTE: all timings are in nano-seconds (1E-9), so the timing is multiplied with
     // the clock-frequency and divided by 1E9. However, this might lead to issues
     // with roll-over of the 32-bit integer. 
-    // TODO: Make the timings settings per stepgen unit
-    litexcnc_stepgen_config_data_t config_data = {0};
-    uint32_t stepspace_cycles = 0;
-    uint32_t steplen_cycles = 0;
-    uint32_t dirhold_cycles = 0;
-    uint32_t dirsetup_cycles = 0;
-
+    litexcnc_stepgen_config_data_t config_data;
     for (size_t i=0; i<litexcnc->stepgen.num_instances; i++) {
         // Get pointer to the stepgen instance
         litexcnc_stepgen_pin_t *instance = &(litexcnc->stepgen.instances[i]);
@@ -241,59 +289,184 @@ uint8_t litexcnc_stepgen_config(litexcnc_t *litexcnc, uint8_t **data, long perio
         // - steplen
         instance->data.steplen_cycles = ceil((float) instance->hal.param.steplen * litexcnc->clock_frequency * 1e-9);
         instance->memo.steplen = instance->hal.param.steplen; 
-        if (instance->data.steplen_cycles > steplen_cycles) {steplen_cycles = instance->data.steplen_cycles;};
         // - stepspace
         instance->data.stepspace_cycles = ceil((float) instance->hal.param.stepspace * litexcnc->clock_frequency * 1e-9);
         instance->memo.stepspace = instance->hal.param.stepspace; 
-        if (instance->data.stepspace_cycles > stepspace_cycles) {stepspace_cycles = instance->data.stepspace_cycles;};
         // - dir_hold_time
         instance->data.dirhold_cycles = ceil((float) instance->hal.param.dir_hold_time * litexcnc->clock_frequency * 1e-9);
         instance->memo.dir_hold_time = instance->hal.param.dir_hold_time; 
-        if (instance->data.dirhold_cycles > dirhold_cycles) {dirhold_cycles = instance->data.dirhold_cycles;};
         // - dir_setup_time
         instance->data.dirsetup_cycles = ceil((float) instance->hal.param.dir_setup_time * litexcnc->clock_frequency * 1e-9);
         instance->memo.dir_setup_time = instance->hal.param.dir_setup_time; 
-        if (instance->data.dirsetup_cycles > dirsetup_cycles) {dirsetup_cycles = instance->data.dirsetup_cycles;};
+
+        // Check whether the parameters fit in the space
+        if (instance->data.steplen_cycles >= 1 << LITEXCNC_STEPGEN_STEPLEN_BITS) {
+            LITEXCNC_ERR("Parameter `steplen` of stepgen %zu too large and is clipped. Consider lowering the frequency of the FPGA.\n", litexcnc->fpga->name, i);
+            instance->data.steplen_cycles = (1 << LITEXCNC_STEPGEN_STEPLEN_BITS) - 1;
+        }
+        if (instance->data.dirhold_cycles >= 1 << LITEXCNC_STEPGEN_DIR_HOLD_TIME_BITS) {
+            LITEXCNC_ERR("Parameter `dir_hold_time` of stepgen %zu too large and is clipped. Consider lowering the frequency of the FPGA.\n", litexcnc->fpga->name, i);
+            instance->data.dirhold_cycles = (1 << LITEXCNC_STEPGEN_DIR_HOLD_TIME_BITS) - 1;
+        }
+        if (instance->data.dirsetup_cycles >= 1 << LITEXCNC_STEPGEN_DIR_SETUP_TIME_BITS) {
+            LITEXCNC_ERR("Parameter `dir_setup_time` of stepgen %zu too large and is clipped. Consider lowering the frequency of the FPGA.\n", litexcnc->fpga->name, i);
+            instance->data.dirsetup_cycles = (1 << LITEXCNC_STEPGEN_DIR_SETUP_TIME_BITS) - 1;
+        }
+
+        // Calculate the maximum step rate of the stepgen, which is limited by the 
+        // resolution of the speed (pick-off) and by the length and space of the steps. In
+        // toggle mode a step is a single edge, the pin has to be held for the step length
+        // between two edges.
+        instance->hal.param.max_frequency = ldexp(litexcnc->clock_frequency, -(int) (instance->data.pick_off_vel - litexcnc->stepgen.data.pick_off_pos + 1));
+        uint32_t step_cycles = instance->data.toggle_step ? instance->data.steplen_cycles : instance->data.steplen_cycles + instance->data.stepspace_cycles;
+        if (step_cycles > 0) {
+            instance->hal.param.max_frequency = fmin(instance->hal.param.max_frequency, (double) litexcnc->clock_frequency / step_cycles);
+        }
+
+        // Convert the timings to the data to be sent to the FPGA
+        config_data.stepdata = htobe32(
+            (instance->data.steplen_cycles  << LITEXCNC_STEPGEN_STEPLEN_OFFSET) | 
+            (instance->data.dirhold_cycles  << LITEXCNC_STEPGEN_DIR_HOLD_TIME_OFFSET) | 
+            (instance->data.dirsetup_cycles << LITEXCNC_STEPGEN_DIR_SETUP_TIME_OFFSET)
+        );
+
+        // Put the data on the data-stream and advance the pointer
+        memcpy(*data, &config_data, LITEXCNC_STEPGEN_CONFIG_DATA_SIZE);
+        *data += LITEXCNC_STEPGEN_CONFIG_DATA_SIZE;
     }
 
-    // Calculate the maximum frequency for stepgen (in if statement to prevent division)
-    if ((litexcnc->stepgen.memo.stepspace_cycles != stepspace_cycles) || (litexcnc->stepgen.memo.steplen_cycles != steplen_cycles)) {
-        litexcnc->stepgen.data.max_frequency = fmin(litexcnc->stepgen.data.max_frequency, (double) litexcnc->clock_frequency / (steplen_cycles + stepspace_cycles));
-        litexcnc->stepgen.memo.steplen_cycles = steplen_cycles;
-        litexcnc->stepgen.memo.stepspace_cycles = stepspace_cycles;
+    return 0;
+}
+
+
+static void litexcnc_stepgen_update_scale(litexcnc_t *litexcnc, size_t i) {
+    // Recalculates the scales for converting from float to FPGA and vice versa when the
+    // position scale of the instance has changed
+    litexcnc_stepgen_pin_t *instance = &(litexcnc->stepgen.instances[i]);
+    litexcnc_stepgen_state_t *state = &(litexcnc->stepgen.state);
+    if (instance->hal.param.position_scale == instance->memo.position_scale) {
+        return;
     }
+    // Prevent division by zero
+    if ((instance->hal.param.position_scale > -1e-20) && (instance->hal.param.position_scale < 1e-20)) {
+        // Value too small, take a safe value
+        instance->hal.param.position_scale = 1.0;
+    }
+    double position_scale = instance->hal.param.position_scale;
+    double clock_frequency = litexcnc->clock_frequency;
+    state->scale_recip[i] = 1.0 / position_scale;
+    instance->memo.position_scale = instance->hal.param.position_scale; 
+    // Calculate the scales for position, speed and acceleration. The FPGA counts in steps
+    // per clock cycle with a fixed number of fractional bits (the pick-off), the powers
+    // of two are applied with `ldexp`, which is exact.
+    state->fpga_pos_scale_inv[i] = ldexp(state->scale_recip[i], -(int) litexcnc->stepgen.data.pick_off_pos);
+    instance->data.fpga_speed_scale = ldexp(position_scale / clock_frequency, instance->data.pick_off_vel);
+    state->fpga_speed_scale_inv[i] = ldexp(clock_frequency * state->scale_recip[i], -(int) instance->data.pick_off_vel);
+    instance->data.fpga_acc_scale = ldexp(position_scale / (clock_frequency * clock_frequency), instance->data.pick_off_acc);
+    instance->data.fpga_acc_scale_inv = ldexp(state->scale_recip[i] * clock_frequency * clock_frequency, -(int) instance->data.pick_off_acc);
+}
+
 
-    // Convert the general data to the correct byte order
-    // - check whether the parameters fits in the space
-    if (steplen_cycles >= 1 << 11) {
-        LITEXCNC_ERR("Parameter `steplen` too large and is clipped. Consider lowering the frequency of the FPGA.\n", litexcnc->fpga->name);
-        steplen_cycles = (1 << 11) - 1;
+static inline uint32_t litexcnc_stepgen_to_fpga_speed(double speed, double scale) {
+    // Converts the speed to the fixed-point value of the FPGA, which is offset by 0x80000000
+    // (standstill). The value is rounded to the nearest speed the FPGA can make and clipped
+    // to the range of the register.
+    double value = rint(speed * scale);
+    if (value > INT32_MAX) {
+        value = INT32_MAX;
+    } else if (value < INT32_MIN) {
+        value = INT32_MIN;
     }
-    if (dirhold_cycles >= 1 << 11) {
-        LITEXCNC_ERR("Parameter `dir_hold_time` too large and is clipped. Consider lowering the frequency of the FPGA.\n", litexcnc->fpga->name);
-        dirhold_cycles = (1 << 11) - 1;
+    return (uint32_t) (int32_t) value + 0x80000000u;
+}
+
+
+static inline uint32_t litexcnc_stepgen_to_fpga_acc(double acceleration, double scale) {
+    // Converts the (positive) acceleration to the fixed-point value of the FPGA. An
+    // acceleration of 0 disables the limit on the FPGA, so a small acceleration is rounded
+    // up to the smallest acceleration the FPGA can make.
+    double value = rint(acceleration * scale);
+    if (value > UINT32_MAX) {
+        value = UINT32_MAX;
+    } else if ((value < 1.0) && (acceleration > 0)) {
+        value = 1.0;
     }
-    if (dirsetup_cycles >= 1 << 13) {
-        LITEXCNC_ERR("Parameter `dir_setup_time` too large and is clipped. Consider lowering the frequency of the FPGA.\n", litexcnc->fpga->name);
-        dirsetup_cycles = (1 << 13) - 1;
+    return (uint32_t) value;
+}
+
+
+static void litexcnc_stepgen_calculate(litexcnc_t *litexcnc, size_t i) {
+    // Calculates the speed and acceleration sent to the FPGA from the inputs of the
+    // instance
+    litexcnc_stepgen_pin_t *instance = &(litexcnc->stepgen.instances[i]);
+    litexcnc_stepgen_state_t *state = &(litexcnc->stepgen.state);
+
+    // Throw error when timings are changed
+    // - steplen
+    if (instance->hal.param.steplen != instance->memo.steplen) {
+        LITEXCNC_ERR("Cannot change parameter `steplen` after configuration of the FPGA. Change is cancelled.\n", litexcnc->fpga->name);
+        instance->hal.param.steplen = instance->memo.steplen;
+    }
+    // - stepspace
+    if (instance->hal.param.stepspace != instance->memo.stepspace) {
+        LITEXCNC_ERR("Cannot change parameter `stepspace` after configuration of the FPGA. Change is cancelled.\n", litexcnc->fpga->name);
+        instance->hal.param.stepspace = instance->memo.stepspace;
+    }
+    // - dir_hold_time
+    if (instance->hal.param.dir_hold_time != instance->memo.dir_hold_time) {
+        LITEXCNC_ERR("Cannot change parameter `dir_hold_time` after configuration of the FPGA. Change is cancelled.\n", litexcnc->fpga->name);
+        instance->hal.param.dir_hold_time = instance->memo.dir_hold_time;
+    }
+    // - dir_setup_time
+    if (instance->hal.param.dir_setup_time != instance->memo.dir_setup_time) {
+        LITEXCNC_ERR("Cannot change parameter `dir_setup_time` after configuration of the FPGA. Change is cancelled.\n", litexcnc->fpga->name);
+        instance->hal.param.dir_setup_time = instance->memo.dir_setup_time;
     }
-    // - convert the timings to the data to be sent to the FPGA
-    config_data.stepdata = htobe32((steplen_cycles << 22) + (dirhold_cycles << 12) + (dirsetup_cycles << 0));
 
-    // Put the data on the data-stream and advance the pointer
-    memcpy(*data, &config_data, LITEXCNC_STEPGEN_CONFIG_DATA_SIZE);
-    *data += LITEXCNC_STEPGEN_CONFIG_DATA_SIZE;
+    // Recalculate the reciprocal of the position scale if it has changed
+    litexcnc_stepgen_update_scale(litexcnc, i);
 
-    return 0;
+    // Limit the speed to the maximum speed (both phases). The speed is also limited by
+    // the maximum step rate of the stepgen.
+    double max_velocity = fmin(instance->hal.param.max_velocity, instance->hal.param.max_frequency * fabs(state->scale_recip[i]));
+    if (*(instance->hal.pin.velocity_cmd) > max_velocity) {
+        *(instance->hal.pin.velocity_cmd) = max_velocity;
+    } else if (*(instance->hal.pin.velocity_cmd) < (-1 * max_velocity)) {
+        *(instance->hal.pin.velocity_cmd) = -1 * max_velocity;
+    }
+
+    // Limit the acceleration to the maximum acceleration (both phases). The acceleration
+    // should be positive
+    if (*(instance->hal.pin.acceleration_cmd) < 0) {
+        *(instance->hal.pin.acceleration_cmd) = -1 * *(instance->hal.pin.acceleration_cmd);
+    }
+    if (*(instance->hal.pin.acceleration_cmd) > instance->hal.param.max_acceleration) {
+        *(instance->hal.pin.acceleration_cmd) = instance->hal.param.max_acceleration;
+    }
+
+    // The data being send to the FPGA (as calculated) in units and seconds. The time
+    // spent accelerating is calculated each period with the reciprocal of the
+    // acceleration. Without acceleration no time is spent accelerating.
+    state->flt_speed[i]    = *(instance->hal.pin.velocity_cmd);
+    instance->hal.param.frequency = state->flt_speed[i] * instance->hal.param.position_scale;
+    instance->data.flt_acc = *(instance->hal.pin.acceleration_cmd);
+    state->flt_acc_recip[i] = instance->data.flt_acc > 0 ? 1.0 / instance->data.flt_acc : 0.0;
+
+    // Convert the speed and acceleration to the units of the FPGA
+    state->fpga_speed[i] = litexcnc_stepgen_to_fpga_speed(state->flt_speed[i], instance->data.fpga_speed_scale);
+    state->fpga_acc[i] = litexcnc_stepgen_to_fpga_acc(instance->data.flt_acc, instance->data.fpga_acc_scale);
 }
 
 
 uint8_t litexcnc_stepgen_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period) {
 
     // Declarations
-    static litexcnc_stepgen_general_write_data_t data_general;
-    static litexcnc_stepgen_pin_t *instance;
-    static litexcnc_stepgen_instance_write_data_t instance_data;
+    litexcnc_stepgen_general_write_data_t data_general;
+    litexcnc_stepgen_pin_t *instance;
+    litexcnc_stepgen_instance_write_data_t instance_data;
+    litexcnc_stepgen_state_t *state = &(litexcnc->stepgen.state);
+    size_t num_instances = litexcnc->stepgen.num_instances;
+    double clock_frequency = litexcnc->clock_frequency;
 
     // Check whether there are stepgen instances. If no instances, no need to write any
     // data (NOTE: when this guard is not in place, the apply_time would be written out
@@ -311,89 +484,53 @@ uint8_t litexcnc_stepgen_prepare_write(litexcnc_t *litexcnc, uint8_t **data, lon
 
     // STEP 2: Speed per stepgen
     // =========================
+    // The speed and acceleration are only recalculated when one of the inputs of the
+    // instance has changed
     for (size_t i=0; i<litexcnc->stepgen.num_instances; i++) {
         // Get pointer to the stepgen instance
         instance = &(litexcnc->stepgen.instances[i]);
-
-        // Throw error when timings are changed
-        // - steplen
-        if (instance->hal.param.steplen != instance->memo.steplen) {
-            LITEXCNC_ERR("Cannot change parameter `steplen` after configuration of the FPGA. Change is cancelled.\n", litexcnc->fpga->name);
-            instance->hal.param.steplen = instance->memo.steplen;
-        }
-        // - stepspace
-        if (instance->hal.param.stepspace != instance->memo.stepspace) {
-            LITEXCNC_ERR("Cannot change parameter `stepspace` after configuration of the FPGA. Change is cancelled.\n", litexcnc->fpga->name);
-            instance->hal.param.stepspace = instance->memo.stepspace;
-        }
-        // - dir_hold_time
-        if (instance->hal.param.dir_hold_time != instance->memo.dir_hold_time) {
-            LITEXCNC_ERR("Cannot change parameter `dir_hold_time` after configuration of the FPGA. Change is cancelled.\n", litexcnc->fpga->name);
-            instance->hal.param.dir_hold_time = instance->memo.dir_hold_time;
-        }
-        // - dir_setup_time
-        if (instance->hal.param.dir_setup_time != instance->memo.dir_setup_time) {
-            LITEXCNC_ERR("Cannot change parameter `dir_setup_time` after configuration of the FPGA. Change is cancelled.\n", litexcnc->fpga->name);
-            instance->hal.param.dir_setup_time = instance->memo.dir_setup_time;
-        }
-
-        // Recalculate the reciprocal of the position scale if it has changed
-        if (instance->hal.param.position_scale != instance->memo.position_scale) {
-            // Prevent division by zero
-            if ((instance->hal.param.position_scale > -1e-20) && (instance->hal.param.position_scale < 1e-20)) {
-                // Value too small, take a safe value
-                instance->hal.param.position_scale = 1.0;
-            }
-            instance->data.scale_recip = 1.0 / instance->hal.param.position_scale;
-            instance->memo.position_scale = instance->hal.param.position_scale; 
-            // Calculate the scales for speed and acceleration
-            instance->data.fpga_speed_scale = (float) (instance->hal.param.position_scale * litexcnc->clock_frequency_recip) * (1LL << litexcnc->stepgen.data.pick_off_vel);
-            instance->data.fpga_speed_scale_inv = (float) litexcnc->clock_frequency * instance->data.scale_recip / (1LL << litexcnc->stepgen.data.pick_off_vel);
-            instance->data.fpga_acc_scale = (float) (instance->hal.param.position_scale * litexcnc->clock_frequency_recip * litexcnc->clock_frequency_recip) * (1LL << (litexcnc->stepgen.data.pick_off_acc));
-            instance->data.fpga_acc_scale_inv =  (float) instance->data.scale_recip * litexcnc->clock_frequency * litexcnc->clock_frequency / (1LL << litexcnc->stepgen.data.pick_off_acc);;
-        }
-
-        // Limit the speed to the maximum speed (both phases)
-        if (*(instance->hal.pin.velocity_cmd) > instance->hal.param.max_velocity) {
-            *(instance->hal.pin.velocity_cmd) = instance->hal.param.max_velocity;
-        } else if (*(instance->hal.pin.velocity_cmd) < (-1 * instance->hal.param.max_velocity)) {
-            *(instance->hal.pin.velocity_cmd) = -1 * instance->hal.param.max_velocity;
-        }
-
-        // Limit the acceleration to the maximum acceleration (both phases). The acceleration
-        // should be positive
-        if (*(instance->hal.pin.acceleration_cmd) < 0) {
-            *(instance->hal.pin.acceleration_cmd) = -1 * *(instance->hal.pin.acceleration_cmd);
-        }
-        if (*(instance->hal.pin.acceleration_cmd) > instance->hal.param.max_acceleration) {
-            *(instance->hal.pin.acceleration_cmd) = instance->hal.param.max_acceleration;
+        litexcnc_stepgen_inputs_t inputs = {
+            .velocity_cmd     = *(instance->hal.pin.velocity_cmd),
+            .acceleration_cmd = *(instance->hal.pin.acceleration_cmd),
+            .max_velocity     = instance->hal.param.max_velocity,
+            .max_acceleration = instance->hal.param.max_acceleration,
+            .position_scale   = instance->hal.param.position_scale,
+            .steplen          = instance->hal.param.steplen,
+            .stepspace        = instance->hal.param.stepspace,
+            .dir_setup_time   = instance->hal.param.dir_setup_time,
+            .dir_hold_time    = instance->hal.param.dir_hold_time,
+        };
+        if (LITEXCNC_INPUTS_CHANGED(instance->memo, inputs)) {
+            litexcnc_stepgen_calculate(litexcnc, i);
         }
+    }
 
-        // The data being send to the FPGA (as calculated) in units and seconds
-        instance->data.flt_speed = *(instance->hal.pin.velocity_cmd);
-        instance->data.flt_acc   = *(instance->hal.pin.acceleration_cmd);
-        instance->data.flt_time  = fabs((*(instance->hal.pin.velocity_cmd) - *(instance->hal.pin.speed_prediction)) / *(instance->hal.pin.acceleration_cmd));
-
-        // Calculate the time spent accelerating in steps and clock cycles
-        instance->data.fpga_speed = (int64_t) (instance->data.flt_speed * instance->data.fpga_speed_scale) + 0x80000000;
-        instance->data.fpga_acc = instance->data.flt_acc * instance->data.fpga_acc_scale;
-        instance->data.fpga_time = instance->data.flt_time * litexcnc->clock_frequency;
+    // STEP 3: Time spent accelerating
+    // ===============================
+    // Calculate the time spent accelerating in clock cycles. This depends on the predicted
+    // speed, which changes each period.
+    for (size_t i=0; i<num_instances; i++) {
+        state->fpga_time[i] = fabs((state->flt_speed[i] - state->speed_prediction[i]) * state->flt_acc_recip[i]) * clock_frequency;
+    }
 
+    // STEP 4: Put the data on the data-stream
+    // =======================================
+    for (size_t i=0; i<litexcnc->stepgen.num_instances; i++) {
         // Convert the integers used and scale it to the FPGA
-        instance_data.speed_target = htobe32(instance->data.fpga_speed);
-        instance_data.acceleration = htobe32(instance->data.fpga_acc);
+        instance_data.speed_target = htobe32(state->fpga_speed[i]);
+        instance_data.acceleration = htobe32(state->fpga_acc[i]);
 
         // Put the data on the data-stream and advance the pointer
         memcpy(*data, &instance_data, LITEXCNC_STEPGEN_INSTANCE_WRITE_DATA_SIZE);
         *data += LITEXCNC_STEPGEN_INSTANCE_WRITE_DATA_SIZE;
 
-        if (*(instance->hal.pin.debug)) {
-            LITEXCNC_PRINT_NO_DEVICE("Stepgen: data sent to FPGA %" PRIu64 ", %" PRIu64 ", %" PRIu32 ", %" PRIu32 ", %" PRIu32 "\n", 
+        if (*(litexcnc->stepgen.instances[i].hal.pin.debug)) {
+            LITEXCNC_PRINT_NO_DEVICE("Stepgen: data sent to FPGA %" PRIu64 ", %" PRIu64 ", %" PRIu32 ", %" PRIu32 ", %.0f\n", 
                 litexcnc->wallclock->memo.wallclock_ticks,
                 litexcnc->stepgen.memo.apply_time,
-                instance->data.fpga_speed,
-                instance->data.fpga_acc,
-                instance->data.fpga_time
+                state->fpga_speed[i],
+                state->fpga_acc[i],
+                state->fpga_time[i]
             );
         }
     }
@@ -414,24 +551,26 @@ float movingAvg(float *ptrArrNumbers, float *ptrSum, size_t pos, size_t len, flo
 uint8_t litexcnc_stepgen_process_read(litexcnc_t *litexcnc, uint8_t** data, long period) {
 
     // Declarations
-    static uint64_t next_apply_time;
-    static int32_t loop_cycles;
-    static litexcnc_stepgen_pin_t *instance;
+    uint64_t next_apply_time;
+    int32_t loop_cycles;
+    litexcnc_stepgen_pin_t *instance;
+    litexcnc_stepgen_state_t *state = &(litexcnc->stepgen.state);
+    size_t num_instances = litexcnc->stepgen.num_instances;
     //  - parameters for retrieving data from FPGA
-    static int64_t pos;
-    static uint32_t speed;
-    // - parameters for determining the position end start of next loop
-    static uint64_t min_time;
-    static uint64_t max_time;
-    static float fraction;
-    static float speed_end;
+    int64_t pos;
+    uint32_t pos_compact;
+    uint32_t speed;
+    int64_t pick_off_pos_mask = ((int64_t) 1 << litexcnc->stepgen.data.pick_off_pos) - 1;
+    // - the offset of the apply time, when the data is written in the next period
+    uint64_t lag_cycles;
+    lag_cycles = litexcnc->write_lag * litexcnc->stepgen.memo.cycles_per_period;
 
     // Check for the first cycle and calculate some fake timings. This has to be done at
     // this location, because in the init the wallclock_ticks is still zero and this would
     // lead to an underflow.
     if (litexcnc->stepgen.memo.apply_time == 0) {
         litexcnc->stepgen.memo.prev_wall_clock = litexcnc->wallclock->memo.wallclock_ticks - litexcnc->stepgen.memo.cycles_per_period;
-        litexcnc->stepgen.memo.apply_time = litexcnc->stepgen.memo.prev_wall_clock + 0.9 * litexcnc->stepgen.memo.cycles_per_period;
+        litexcnc->stepgen.memo.apply_time = litexcnc->stepgen.memo.prev_wall_clock + lag_cycles + 0.9 * litexcnc->stepgen.memo.cycles_per_period;
     }
 
     // The next apply time is basically chosen so that the next loop starts exactly when it
@@ -457,26 +596,27 @@ uint8_t litexcnc_stepgen_process_read(litexcnc_t *litexcnc, uint8_t** data, long
 
     // Check whether the nex_apply_time is within the expected range. When outside of the range, 
     // the value is clipped and a warning is shown to the user. The warning is only shown once.
-    if (next_apply_time < litexcnc->wallclock->memo.wallclock_ticks + 0.81 * litexcnc->stepgen.memo.cycles_per_period) {
+    // When the data is written in the next period (communicate), the range shifts one period.
+    if (next_apply_time < litexcnc->wallclock->memo.wallclock_ticks + lag_cycles + 0.81 * litexcnc->stepgen.memo.cycles_per_period) {
         rtapi_print("Apply time exceeding limits (too short): %" PRIu64 ", %" PRIu64 ", %" PRIu64 "\n",
             litexcnc->wallclock->memo.wallclock_ticks,
             litexcnc->stepgen.memo.apply_time,
             next_apply_time
         );  
-        next_apply_time = litexcnc->wallclock->memo.wallclock_ticks + 0.85 * litexcnc->stepgen.memo.cycles_per_period;
+        next_apply_time = litexcnc->wallclock->memo.wallclock_ticks + lag_cycles + 0.85 * litexcnc->stepgen.memo.cycles_per_period;
         // Show warning
         if (!litexcnc->stepgen.data.warning_apply_time_exceeded_shown) {
             LITEXCNC_ERR_NO_DEVICE("Apply time exceeded limits.");
             litexcnc->stepgen.data.warning_apply_time_exceeded_shown = true;
         }
     }
-    if (next_apply_time > litexcnc->wallclock->memo.wallclock_ticks + 0.99 * litexcnc->stepgen.memo.cycles_per_period){
+    if (next_apply_time > litexcnc->wallclock->memo.wallclock_ticks + lag_cycles + 0.99 * litexcnc->stepgen.memo.cycles_per_period){
         rtapi_print("Apply time exceeding limits (too long): %" PRIu64 ", %" PRIu64 ", %" PRIu64 "\n",
             litexcnc->wallclock->memo.wallclock_ticks,
             litexcnc->stepgen.memo.apply_time,
             next_apply_time
         );     
-        next_apply_time = litexcnc->wallclock->memo.wallclock_ticks + 0.95 * litexcnc->stepgen.memo.cycles_per_period;
+        next_apply_time = litexcnc->wallclock->memo.wallclock_ticks + lag_cycles + 0.95 * litexcnc->stepgen.memo.cycles_per_period;
         // Show warning
         if (!litexcnc->stepgen.data.warning_apply_time_exceeded_shown) {
             LITEXCNC_ERR_NO_DEVICE("Apply time exceeded limits.");
@@ -499,96 +639,112 @@ uint8_t litexcnc_stepgen_process_read(litexcnc_t *litexcnc, uint8_t** data, long
     }
     litexcnc->stepgen.memo.prev_wall_clock = litexcnc->wallclock->memo.wallclock_ticks;
 
-    // Receive and process the data for all the stepgens
+    // Receive the data for all the stepgens
     for (size_t i=0; i<litexcnc->stepgen.num_instances; i++) {
         // Get pointer to the stepgen instance
         instance = &(litexcnc->stepgen.instances[i]);
 
         // Recalculate the reciprocal of the position scale if it has changed
-        if (instance->hal.param.position_scale != instance->memo.position_scale) {
-            // Prevent division by zero
-            if ((instance->hal.param.position_scale > -1e-20) && (instance->hal.param.position_scale < 1e-20)) {
-		        // Value too small, take a safe value
-		        instance->hal.param.position_scale = 1.0;
-	        }
-            instance->data.scale_recip = 1.0 / instance->hal.param.position_scale;
-            instance->memo.position_scale = instance->hal.param.position_scale; 
-            // Calculate the scales for speed and acceleration
-            instance->data.fpga_pos_scale_inv = (float) instance->data.scale_recip / (1LL << litexcnc->stepgen.data.pick_off_pos);
-            instance->data.fpga_speed_scale = (float) (instance->hal.param.position_scale * litexcnc->clock_frequency_recip) * (1LL << litexcnc->stepgen.data.pick_off_vel);
-            instance->data.fpga_speed_scale_inv = 1.0f / instance->data.fpga_speed_scale;
-            instance->data.fpga_acc_scale = (float) (instance->hal.param.position_scale * litexcnc->clock_frequency_recip * litexcnc->clock_frequency_recip) * (1LL << (litexcnc->stepgen.data.pick_off_acc));
-            instance->data.fpga_acc_scale_inv =  (float) instance->data.scale_recip * litexcnc->clock_frequency * litexcnc->clock_frequency / (1LL << litexcnc->stepgen.data.pick_off_acc);;
-        }
+        litexcnc_stepgen_update_scale(litexcnc, i);
 
         // Store the old data
-        instance->memo.position = instance->data.position;
+        instance->memo.position = state->position[i];
         // Read data and proceed the buffer
-        memcpy(&pos, *data, sizeof pos);
-        instance->data.position = be64toh(pos);
-        *data += 8;  // The data read is 64 bit-wide. The buffer is 8-bit wide
+        if (litexcnc->config.compact_status) {
+            // The position is a 32-bit window of the full position, the (wrapped) 
+            // difference with the previous position is added to the previous position.
+            memcpy(&pos_compact, *data, sizeof pos_compact);
+            pos = state->position[i] >> STEPGEN_COMPACT_POSITION_SHIFT;
+            pos += (int32_t)(be32toh(pos_compact) - (uint32_t) pos);
+            state->position[i] = pos * (1LL << STEPGEN_COMPACT_POSITION_SHIFT);
+            *data += 4;  // The data read is 32 bit-wide. The buffer is 8-bit wide
+        } else {
+            memcpy(&pos, *data, sizeof pos);
+            state->position[i] = be64toh(pos);
+            *data += 8;  // The data read is 64 bit-wide. The buffer is 8-bit wide
+        }
         memcpy(&speed, *data, sizeof speed);
-        instance->data.speed = (int64_t) be32toh(speed) -  0x80000000;
         *data += 4;  // The data read is 32 bit-wide. The buffer is 8-bit wide
+        // Convert the received position and speed to floating-point values. The whole steps
+        // and the fraction of the position are converted separately, so no steps are lost
+        // when the position no longer fits in the mantissa of a double.
+        state->position_fb[i] = 
+            (double) (state->position[i] >> litexcnc->stepgen.data.pick_off_pos) * state->scale_recip[i] +
+            (double) (state->position[i] & pick_off_pos_mask) * state->fpga_pos_scale_inv[i];
+        state->speed_fb[i] = (double) (int32_t) (be32toh(speed) - 0x80000000u) * state->fpga_speed_scale_inv[i];
+    }
+
+    /* -------------------
+     * Predict the position and speed at the theoretical end of the start of the update
+     * period. The prediction is based on:
+     *    - if there is a pending apply time (apply_time > wall_clock) the movement until that
+     *      apply time based on the position, speed and acceleration as read from the FPGA.
+     *    - any movement (with respect to speed and acceleration) which happens until the next
+     *      apply time, which is typically equal to the period of the function.
+     *
+     * This function is placed under read, as it uses the output from the previous cycle. If this
+     * was to be placed under the write cycle, errors might occur if the input variables such
+     * as the acceleration would change between read and write.
+     *
+     * The times are taken relative to the wall clock, so all instances are processed in a
+     * single loop without branches, which the compiler can vectorise.
+     * ------------------- 
+     */
+    // - the start of the acceleration phase (apply time, or now when already passed) and
+    //   the start of the next period, both relative to the wall clock
+    double apply_offset = (double) (int64_t) (litexcnc->stepgen.memo.apply_time - litexcnc->wallclock->memo.wallclock_ticks);
+    double next_apply_offset = (double) (int64_t) (next_apply_time - litexcnc->wallclock->memo.wallclock_ticks);
+    double start_offset = apply_offset > 0 ? apply_offset : 0;
+    double clock_frequency_recip = litexcnc->clock_frequency_recip;
+    for (size_t i=0; i<num_instances; i++) {
+        // - start with the current speed and position
+        double position = state->position_fb[i];
+        double speed = state->speed_fb[i];
+        // - the part of the acceleration phase before the next apply time. The speed 
+        //   changes linearly from the current speed to the target speed.
+        double end_offset = apply_offset + state->fpga_time[i];
+        double max_offset = end_offset < next_apply_offset ? end_offset : next_apply_offset;
+        //   When no time of the phase remains, the fraction is 1.0. The division is
+        //   performed in any case (the times are whole cycles), so the loop contains no
+        //   branches.
+        double remaining = end_offset - start_offset;
+        double divisor = remaining < 1.0 ? 1.0 : remaining;
+        double fraction = (remaining > 0 ? max_offset - start_offset : divisor) / divisor;
+        double speed_end = (1.0 - fraction) * speed + fraction * state->flt_speed[i];
+        double position_end = position + 0.5 * (speed + speed_end) * (max_offset - start_offset) * clock_frequency_recip;
+        bool accelerating = end_offset >= 0;
+        position = accelerating ? position_end : position;
+        speed = accelerating ? speed_end : speed;
+        // - the part at constant speed (target speed reached before the next apply time)
+        position_end = position + state->flt_speed[i] * (next_apply_offset - end_offset) * clock_frequency_recip;
+        bool constant = next_apply_offset > end_offset;
+        position = constant ? position_end : position;
+        speed = constant ? state->flt_speed[i] : speed;
+        state->position_prediction[i] = position;
+        state->speed_prediction[i] = speed;
+    }
+
+    // Publish the results on the HAL pins
+    for (size_t i=0; i<litexcnc->stepgen.num_instances; i++) {
+        // Get pointer to the stepgen instance
+        instance = &(litexcnc->stepgen.instances[i]);
         // Convert the received position to HAL pins for counts and floating-point position
-        *(instance->hal.pin.counts) = instance->data.position >> litexcnc->stepgen.data.pick_off_pos;
+        *(instance->hal.pin.counts) = state->position[i] >> litexcnc->stepgen.data.pick_off_pos;
         // Check: why is a half step subtracted from the position. Will case a possible problem 
         // when the power is cycled -> will lead to a moving reference frame  
         // *(instance->hal.pin.position_fb) = (double)(instance->data.position-(1LL<<(litexcnc->stepgen.data.pick_off_pos-1))) * instance->data.scale_recip / (1LL << litexcnc->stepgen.data.pick_off_pos);
-        *(instance->hal.pin.position_fb) = (double) instance->data.position * instance->data.fpga_pos_scale_inv;
-        *(instance->hal.pin.speed_fb) = (double) instance->data.speed * instance->data.fpga_speed_scale_inv;
-
-        /* -------------------
-         * Predict the position and speed at the theoretical end of the start of the 
-         * update period. The prediction is based on:
-         *    - if there is a pending apply time (apply_time > wall_clock) the movement until that
-         *      apply time based on the position, speed and acceleration as read from the FPGA.
-         *    - any movement (with respect to speed and acceleration) which happens until the next
-         *      apply time, which is typically equal to the period of the function.
-         *
-         * This function is placed under read, as it uses the output from the previous cycle. If this
-         * was to be placed under the write cycle, errors might occur if the input variables such
-         * as the acceleration would change between read and write.
-         * ------------------- 
-         */
-        // - start with the current speed and position
-        *(instance->hal.pin.speed_prediction) = *(instance->hal.pin.speed_fb);
-        *(instance->hal.pin.position_prediction) =  *(instance->hal.pin.position_fb);
-        
-        // Add the different phases to the speed and position prediction
+        *(instance->hal.pin.position_fb) = state->position_fb[i];
+        *(instance->hal.pin.speed_fb) = state->speed_fb[i];
+        *(instance->hal.pin.position_prediction) = state->position_prediction[i];
+        *(instance->hal.pin.speed_prediction) = state->speed_prediction[i];
         if (*(instance->hal.pin.debug)) {
-            rtapi_print("Timings: %.6f, %" PRIu64 ", %" PRIu64 ", %" PRIu32 ", %" PRIu64 "\n",
+            rtapi_print("Timings: %.6f, %" PRIu64 ", %" PRIu64 ", %.0f, %" PRIu64 "\n",
                 *(litexcnc->stepgen.hal->pin.period_s),
                 litexcnc->wallclock->memo.wallclock_ticks,
                 litexcnc->stepgen.memo.apply_time,
-                instance->data.fpga_time,
+                state->fpga_time[i],
                 next_apply_time
             );
-        }
-        if (litexcnc->wallclock->memo.wallclock_ticks <= litexcnc->stepgen.memo.apply_time + instance->data.fpga_time) {
-            min_time = litexcnc->wallclock->memo.wallclock_ticks;
-            if (litexcnc->stepgen.memo.apply_time > min_time) {
-                min_time = litexcnc->stepgen.memo.apply_time;
-            }
-            max_time = litexcnc->stepgen.memo.apply_time + instance->data.fpga_time;
-            if (next_apply_time < max_time) {
-                max_time = next_apply_time;
-            }
-            if ((litexcnc->stepgen.memo.apply_time + instance->data.fpga_time - min_time) <= 0) {
-                fraction = 1.0;
-            } else {
-                fraction = (float) (max_time - min_time) / (litexcnc->stepgen.memo.apply_time + instance->data.fpga_time - min_time);
-            }
-            speed_end = (1.0 - fraction) * *(instance->hal.pin.speed_prediction) + fraction * instance->data.flt_speed;
-            *(instance->hal.pin.position_prediction) += 0.5 * (*(instance->hal.pin.speed_prediction) + speed_end) * (max_time - min_time) * litexcnc->clock_frequency_recip;
-            *(instance->hal.pin.speed_prediction) = speed_end;
-        }
-        if (next_apply_time > litexcnc->stepgen.memo.apply_time + instance->data.fpga_time) {
-            // Some constant speed should be added
-            *(instance->hal.pin.speed_prediction) = instance->data.flt_speed;
-            *(instance->hal.pin.position_prediction) += instance->data.flt_speed * (next_apply_time - (litexcnc->stepgen.memo.apply_time + instance->data.fpga_time)) * litexcnc->clock_frequency_recip;
-        }
-        if (*(instance->hal.pin.debug)) {
             rtapi_print("Stepgen speed feedback result: %" PRIu64 ", %" PRIu64 ", %.6f, %.6f, %.6f, %.6f \n",
                 litexcnc->wallclock->memo.wallclock_ticks,
                 next_apply_time,
@@ -605,3 +761,43 @@ uint8_t litexcnc_stepgen_process_read(litexcnc_t *litexcnc, uint8_t** data, long
 
     return 0;
 }
+
+
+void litexcnc_stepgen_realign(litexcnc_t *litexcnc) {
+    // The FPGA has been reset after the link with the FPGA was lost. The positions of
+    // the stepgens start from zero again and the timing is derived from the wall clock
+    // with the next read, as in the first period.
+    litexcnc->stepgen.memo.apply_time = 0;
+    for (size_t i=0; i<litexcnc->stepgen.num_instances; i++) {
+        litexcnc->stepgen.state.position[i] = 0;
+        litexcnc->stepgen.instances[i].memo.position = 0;
+    }
+}
+
+
+static size_t litexcnc_stepgen_config_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_BOARD_STEPGEN_CONFIG_DATA_SIZE(litexcnc);
+}
+
+
+static size_t litexcnc_stepgen_write_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_BOARD_STEPGEN_DATA_WRITE_SIZE(litexcnc);
+}
+
+
+static size_t litexcnc_stepgen_read_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_BOARD_STEPGEN_DATA_READ_SIZE(litexcnc);
+}
+
+
+// Description of the module for the LitexCNC driver (see `litexcnc_module_t`)
+const litexcnc_module_t litexcnc_stepgen_module = {
+    .name = "Stepgen",
+    .init = litexcnc_stepgen_init,
+    .config = litexcnc_stepgen_config,
+    .config_size = litexcnc_stepgen_config_size,
+    .prepare_write = litexcnc_stepgen_prepare_write,
+    .write_size = litexcnc_stepgen_write_size,
+    .process_read = litexcnc_stepgen_process_read,
+    .read_size = litexcnc_stepgen_read_size,
+};
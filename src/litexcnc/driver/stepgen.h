@@ -40,6 +40,23 @@
 
 #define STEPGEN_WALLCLOCK_BUFFER 10
 #define STEPGEN_WALLCLOCK_BUFFER_RECIP 1.0 / STEPGEN_WALLCLOCK_BUFFER
+// The maximum step frequency of a driver when it is not set in the configuration (must
+// be equal to the default of the firmware)
+#define STEPGEN_DEFAULT_MAX_FREQUENCY 400e3
+
+// The inputs of a stepgen instance from which the data sent to the FPGA is derived (see
+// `litexcnc_inputs_changed`)
+typedef struct {
+    hal_float_t velocity_cmd;
+    hal_float_t acceleration_cmd;
+    hal_float_t max_velocity;
+    hal_float_t max_acceleration;
+    hal_float_t position_scale;
+    hal_u32_t steplen;
+    hal_u32_t stepspace;
+    hal_u32_t dir_setup_time;
+    hal_u32_t dir_hold_time;
+} litexcnc_stepgen_inputs_t;
 
 // Defines the structure of the PWM instance
 typedef struct {
@@ -68,6 +85,8 @@ typedef struct {
             hal_u32_t   stepspace;            /* The minimum space between step pulses, in nanoseconds. Measured from falling edge to rising edge. The actual time depends on the step rate and can be much longer. Is used to calculate the maximum stepping frequency */ 
             hal_u32_t   dir_setup_time;       /* The minimum setup time from direction to step, in nanoseconds. Measured from change of direction to rising edge of step. */
             hal_u32_t   dir_hold_time;        /* The minimum hold time of direction after step, in nanoseconds. Measured from falling edge of step to change of direction */
+            hal_float_t max_driver_freq;      /* The maximum step frequency of the driver, in pulses per second, as configured in the firmware. In toggle mode the maximum step rate is twice this frequency. */
+            hal_float_t max_frequency;        /* The maximum step rate of the stepgen, in steps per second, limited by the resolution of the speed on the FPGA and the step timings. */
         } param;
 
     } hal;
@@ -85,34 +104,34 @@ typedef struct {
         hal_float_t maxaccel;       
         hal_float_t maxvel;
         bool error_max_speed_printed;
+        litexcnc_stepgen_inputs_t inputs;
+        bool inputs_valid;
     } memo;
 
-    // This struct contains data, both calculated and direct received from the FPGA
+    // This struct contains data calculated when the inputs change. The data used each
+    // period is stored in `litexcnc_stepgen_state_t`.
     struct {
-        int64_t position;
-        int32_t speed;
         float acceleration;
         float speed_float;
-        float scale_recip;
         float acc_recip;
         hal_u32_t steplen_cycles;
         hal_u32_t stepspace_cycles;
         hal_u32_t dirsetup_cycles;
         hal_u32_t dirhold_cycles;
+        // The pick-offs of the speed and acceleration of this instance (the pick-off of
+        // the position is the same for all instances)
+        size_t pick_off_vel;
+        size_t pick_off_acc;
+        // Each edge of the step pin is a step (step mode `toggle`), otherwise each step is
+        // a pulse
+        bool toggle_step;
         // The data being send to the FPGA (as calculated)
-        float flt_acc;
-        float flt_speed;
-        float flt_time;
-        // The data being send to the FPGA (as sent)
-        uint32_t fpga_acc;
-        uint32_t fpga_speed;
-        uint32_t fpga_time;
-        // Scales for converting from float to FPGA and vice versa
-        float fpga_pos_scale_inv;
-        float fpga_speed_scale;
-        float fpga_speed_scale_inv;
-        float fpga_acc_scale;
-        float fpga_acc_scale_inv;
+        double flt_acc;
+        // Scales for converting from float to FPGA and vice versa. The scales include the
+        // pick-offs, so the product is the fixed-point value of the FPGA.
+        double fpga_speed_scale;
+        double fpga_acc_scale;
+        double fpga_acc_scale_inv;
     } data;
     
 } litexcnc_stepgen_pin_t;
@@ -124,38 +143,58 @@ typedef struct {
         hal_float_t *period_s;            /* The calculated period (averaged over 10 cycles) based on the FPGA wall clock */ 
         hal_float_t *period_s_recip;      /* The reciprocal of the calculated period. Calculated here once, to prevent slow division on multiple locations */ 
     } pin;
-
-    struct {
-        hal_float_t max_driver_freq;
-    } param;
     
 } litexcnc_stepgen_hal_t;
 
+// The data of all stepgen instances which is used each period, stored as an array per
+// field (indexed by the number of the instance). The read and write functions process
+// all instances with simple loops over these arrays, which the compiler can vectorise.
+// The HAL pins and the data used only when the inputs change are kept per instance (see
+// `litexcnc_stepgen_pin_t`).
+typedef struct {
+    // Received from the FPGA
+    int64_t *position;
+    // Scales for converting from FPGA to float (the reciprocal of the position scale for
+    // whole steps, the others include the pick-offs)
+    double *scale_recip;
+    double *fpga_pos_scale_inv;
+    double *fpga_speed_scale_inv;
+    // Feedback and prediction (as published on the HAL pins, which are volatile)
+    double *position_fb;
+    double *speed_fb;
+    double *position_prediction;
+    double *speed_prediction;
+    // The data being send to the FPGA (as calculated)
+    double *flt_speed;
+    double *flt_acc_recip;
+    // The data being send to the FPGA (as sent)
+    uint32_t *fpga_speed;
+    uint32_t *fpga_acc;
+    // The time spent accelerating, in clock cycles
+    double *fpga_time;
+} litexcnc_stepgen_state_t;
+
 // Defines the PWM, contains a collection of PWM instances
 typedef struct {
     // Input pins
     int num_instances;
     litexcnc_stepgen_pin_t *instances;
     litexcnc_stepgen_hal_t *hal;
+    litexcnc_stepgen_state_t state;
 
     struct {
         long period;
         float period_s;
         float period_s_recip;
         float cycles_per_period;
-        uint32_t steplen_cycles;
-        uint32_t stepspace_cycles;
         uint64_t apply_time;
         uint64_t prev_wall_clock;
     } memo;
     
     // Struct containing pre-calculated values
     struct {
-        float max_frequency;
         bool warning_apply_time_exceeded_shown;
         size_t pick_off_pos;
-        size_t pick_off_vel;
-        size_t pick_off_acc;
         // Data for calculating the average period_s
         size_t wallclock_buffer_pos;
         float wallclock_buffer_sum;
@@ -167,13 +206,21 @@ typedef struct {
 
 // Defines the data-package for sending the settings for a single step generator. The
 // order of this package MUST coincide with the order in the MMIO definition.
-// - config
+// - config (for each instance)
 #pragma pack(push, 4)
 typedef struct {
     uint32_t stepdata;
 } litexcnc_stepgen_config_data_t;
 #pragma pack(pop)
 #define LITEXCNC_STEPGEN_CONFIG_DATA_SIZE sizeof(litexcnc_stepgen_config_data_t)
+#define LITEXCNC_BOARD_STEPGEN_CONFIG_DATA_SIZE(litexcnc) LITEXCNC_STEPGEN_CONFIG_DATA_SIZE*litexcnc->stepgen.num_instances
+// - the fields of the stepdata (offset and width in bits, see `stepgen.py`)
+#define LITEXCNC_STEPGEN_STEPLEN_OFFSET          0
+#define LITEXCNC_STEPGEN_STEPLEN_BITS           10
+#define LITEXCNC_STEPGEN_DIR_HOLD_TIME_OFFSET   10
+#define LITEXCNC_STEPGEN_DIR_HOLD_TIME_BITS     10
+#define LITEXCNC_STEPGEN_DIR_SETUP_TIME_OFFSET  20
+#define LITEXCNC_STEPGEN_DIR_SETUP_TIME_BITS    12
 // - write
 #pragma pack(push,4)
 typedef struct {
@@ -196,7 +243,18 @@ typedef struct {
     uint32_t speed;
 } litexcnc_stepgen_instance_read_data_t;
 #pragma pack(pop)
-#define LITEXCNC_BOARD_STEPGEN_DATA_READ_SIZE(litexcnc) litexcnc->stepgen.num_instances*sizeof(litexcnc_stepgen_instance_read_data_t)
+// - read (compact status, the position is truncated to 32 bits, see STEPGEN_COMPACT_POSITION_SHIFT)
+#pragma pack(push,4)
+typedef struct {
+    uint32_t position;
+    uint32_t speed;
+} litexcnc_stepgen_instance_read_data_compact_t;
+#pragma pack(pop)
+#define LITEXCNC_BOARD_STEPGEN_DATA_READ_SIZE(litexcnc) litexcnc->stepgen.num_instances*(litexcnc->config.compact_status?sizeof(litexcnc_stepgen_instance_read_data_compact_t):sizeof(litexcnc_stepgen_instance_read_data_t))
+// With the compact status, the FPGA sends the bits 16 - 47 of the position. The full 
+// position is reconstructed from the previous position, which requires the position to
+// change less than 2^15 steps between two reads.
+#define STEPGEN_COMPACT_POSITION_SHIFT 16
 
 
 // Functions for creating, reading and writing stepgen pins
@@ -204,5 +262,7 @@ int litexcnc_stepgen_init(litexcnc_t *litexcnc, cJSON *config);
 uint8_t litexcnc_stepgen_config(litexcnc_t *litexcnc, uint8_t **data, long period);
 uint8_t litexcnc_stepgen_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period);
 uint8_t litexcnc_stepgen_process_read(litexcnc_t *litexcnc, uint8_t** data, long period);
+void litexcnc_stepgen_realign(litexcnc_t *litexcnc);
+extern const litexcnc_module_t litexcnc_stepgen_module;
 
 #endif
\ No newline at end of file
@@ -74,16 +74,30 @@ fail_pins:
 //     return r;
 }
 
-uint8_t litexcnc_wallclock_prepare_write(litexcnc_t *litexcnc, uint8_t **data) {
+uint8_t litexcnc_wallclock_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period) {
     // This function is deliberately empty, as the wall clock is not written.
     return 0;
 }
 
-uint8_t litexcnc_wallclock_process_read(litexcnc_t *litexcnc, uint8_t** data) {
-
-    static uint64_t ticks;
-    static uint32_t msb;
-    static uint32_t lsb;
+uint8_t litexcnc_wallclock_process_read(litexcnc_t *litexcnc, uint8_t** data, long period) {
+
+    uint64_t ticks;
+    uint32_t msb;
+    uint32_t lsb;
+
+    // With the compact status only the least significant 4 bytes are read. The full
+    // value is reconstructed from the previous value, which requires the wall clock to
+    // be read at least once per roll-over of the LSB (order of magnitude minutes).
+    if (litexcnc->config.compact_status) {
+        memcpy(&lsb, *data, sizeof lsb);
+        lsb = be32toh(lsb);
+        ticks = litexcnc->wallclock->memo.wallclock_ticks;
+        litexcnc->wallclock->memo.wallclock_ticks = ticks + (uint32_t)(lsb - (uint32_t) ticks);
+        *(litexcnc->wallclock->hal.pin.wallclock_ticks_msb) = litexcnc->wallclock->memo.wallclock_ticks >> 32;
+        *(litexcnc->wallclock->hal.pin.wallclock_ticks_lsb) = lsb;
+        (*data)+=4;
+        return 0;
+    }
 
     // Get the full value (fool-proof way ;) )
     memcpy(&ticks , *data, sizeof ticks);
@@ -100,4 +114,24 @@ uint8_t litexcnc_wallclock_process_read(litexcnc_t *litexcnc, uint8_t** data) {
     return 0;
 }
 
+void litexcnc_wallclock_realign(litexcnc_t *litexcnc, uint64_t elapsed_ns) {
+    // The wall clock continues while the link with the FPGA is lost. With the compact
+    // status the full value is reconstructed from the previous value, so that value is
+    // moved forward by the time elapsed (which should not be overestimated, as the LSB
+    // can only be extended forward).
+    litexcnc->wallclock->memo.wallclock_ticks += (uint64_t) ((double) elapsed_ns * 1e-9 * litexcnc->clock_frequency);
+}
+
+
+static size_t litexcnc_wallclock_read_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_WALLCLOCK_DATA_READ_SIZE(litexcnc);
+}
+
 
+// Description of the module for the LitexCNC driver (see `litexcnc_module_t`)
+const litexcnc_module_t litexcnc_wallclock_module = {
+    .name = "Wallclock",
+    .init = litexcnc_wallclock_init,
+    .process_read = litexcnc_wallclock_process_read,
+    .read_size = litexcnc_wallclock_read_size,
+};
@@ -72,12 +72,21 @@ typedef struct {
     uint64_t count;
 } litexcnc_wallclock_data_read_t;
 #pragma pack(pop)
-#define LITEXCNC_WALLCLOCK_DATA_READ_SIZE sizeof(litexcnc_wallclock_data_read_t)
+// - read (compact status, only the least significant 4 bytes)
+#pragma pack(push,4)
+typedef struct {
+    // Input pins
+    uint32_t count_lsb;
+} litexcnc_wallclock_data_read_compact_t;
+#pragma pack(pop)
+#define LITEXCNC_WALLCLOCK_DATA_READ_SIZE(litexcnc) (litexcnc->config.compact_status?sizeof(litexcnc_wallclock_data_read_compact_t):sizeof(litexcnc_wallclock_data_read_t))
 
 // Functions for creating, reading and writing wall-clock pins
 int litexcnc_wallclock_init(litexcnc_t *litexcnc, cJSON *config);
 uint8_t litexcnc_wallclock_config(litexcnc_t *litexcnc, uint8_t **data, long period);
-uint8_t litexcnc_wallclock_prepare_write(litexcnc_t *litexcnc, uint8_t **data);
-uint8_t litexcnc_wallclock_process_read(litexcnc_t *litexcnc, uint8_t** data);
+uint8_t litexcnc_wallclock_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period);
+uint8_t litexcnc_wallclock_process_read(litexcnc_t *litexcnc, uint8_t** data, long period);
+void litexcnc_wallclock_realign(litexcnc_t *litexcnc, uint64_t elapsed_ns);
+extern const litexcnc_module_t litexcnc_wallclock_module;
 
 #endif
\ No newline at end of file
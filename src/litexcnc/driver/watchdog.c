@@ -135,7 +135,7 @@ uint8_t litexcnc_watchdog_prepare_write(litexcnc_t *litexcnc, uint8_t **data, lo
     return 0;
 }
 
-uint8_t litexcnc_watchdog_process_read(litexcnc_t *litexcnc, uint8_t** data) {
+uint8_t litexcnc_watchdog_process_read(litexcnc_t *litexcnc, uint8_t** data, long period) {
 
     // Check whether the watchdog did bite
     if (*(*data)) {
@@ -149,4 +149,25 @@ uint8_t litexcnc_watchdog_process_read(litexcnc_t *litexcnc, uint8_t** data) {
     
     // Success
     return 0;
-}
\ No newline at end of file
+}
+
+
+static size_t litexcnc_watchdog_write_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_WATCHDOG_DATA_WRITE_SIZE;
+}
+
+
+static size_t litexcnc_watchdog_read_size(litexcnc_t *litexcnc) {
+    return LITEXCNC_WATCHDOG_DATA_READ_SIZE;
+}
+
+
+// Description of the module for the LitexCNC driver (see `litexcnc_module_t`)
+const litexcnc_module_t litexcnc_watchdog_module = {
+    .name = "Watchdog",
+    .init = litexcnc_watchdog_init,
+    .prepare_write = litexcnc_watchdog_prepare_write,
+    .write_size = litexcnc_watchdog_write_size,
+    .process_read = litexcnc_watchdog_process_read,
+    .read_size = litexcnc_watchdog_read_size,
+};
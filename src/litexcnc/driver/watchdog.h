@@ -87,6 +87,7 @@ typedef struct {
 int litexcnc_watchdog_init(litexcnc_t *litexcnc, cJSON *config);
 uint8_t litexcnc_watchdog_config(litexcnc_t *litexcnc, uint8_t **data, long period);
 uint8_t litexcnc_watchdog_prepare_write(litexcnc_t *litexcnc, uint8_t **data, long period);
-uint8_t litexcnc_watchdog_process_read(litexcnc_t *litexcnc, uint8_t** data);
+uint8_t litexcnc_watchdog_process_read(litexcnc_t *litexcnc, uint8_t** data, long period);
+extern const litexcnc_module_t litexcnc_watchdog_module;
 
 #endif
\ No newline at end of file
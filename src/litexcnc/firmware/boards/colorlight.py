@@ -4,6 +4,7 @@ from litex.soc.integration.soc_core import *
 from litex_boards.targets.colorlight_5a_75x import _CRG
 from litex_boards.platforms import colorlight_5a_75b, colorlight_5a_75e
 
+from ..etherbone import add_etherbone
 from ..soc import LitexCNC_Firmware
 
 
@@ -40,7 +41,8 @@ class ColorLightBase(SoCMini):
             clock_pads = self.platform.request("eth_clocks"),
             pads       = self.platform.request("eth"),
             **{key: value for key, value in config.ethphy.dict(exclude={'module'}).items() if value is not None})
-        self.add_etherbone(
+        add_etherbone(
+            self,
             phy=self.ethphy,
             mac_address=config.etherbone.mac_address,
             ip_address=str(config.etherbone.ip_address),
@@ -14,6 +14,7 @@ from litex.soc.integration.soc_core import *
 from litex.soc.cores.clock import S6PLL
 from migen import ClockDomain, Module
 
+from ..etherbone import add_etherbone
 from ..soc import LitexCNC_Firmware
 
 # IOs ---------------------------------------------------------------
@@ -344,7 +345,8 @@ class RV901T(SoCMini):
             }
         )
         self.submodules += self.ethphy
-        self.add_etherbone(
+        add_etherbone(
+            self,
             phy=self.ethphy,
             mac_address=config.etherbone.mac_address,
             ip_address=str(config.etherbone.ip_address),
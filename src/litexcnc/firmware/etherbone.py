@@ -3,8 +3,13 @@
 """
 from ipaddress import IPv4Address
 from typing import Type
+from typing_extensions import Literal
 
-from pydantic import BaseModel, Field, validator
+from pydantic import BaseModel, Field, root_validator, validator
+
+from migen import *
+from litex.soc.interconnect import stream
+from liteeth.common import eth_etherbone_record_description, eth_etherbone_mmap_description
 
 
 class EthPhy(BaseModel):
@@ -40,7 +45,179 @@ class Etherbone(BaseModel):
         "192.168.0.50",
         help_text="The ip-address to communicate with the FPGA-card."
     )
+    transport: Literal['udp', 'raw', 'xdp'] = Field(
+        'udp',
+        help_text="The transport used by the driver to communicate with the FPGA-card. "
+        "With 'udp' the sockets of the kernel are used. With 'raw' the Ethernet frames "
+        "are sent and received directly on the interface (AF_PACKET), bypassing the "
+        "IP/UDP stack of the kernel. With 'xdp' the frames are exchanged through an "
+        "AF_XDP socket, which avoids copying the data when the network card supports "
+        "zero-copy. This setting only affects the driver."
+    )
+    interface: str = Field(
+        None,
+        help_text="The network interface connected to the FPGA-card, for example "
+        "'eth0'. Required when the transport is 'raw' or 'xdp'."
+    )
+    io_worker: bool = Field(
+        False,
+        help_text="When set, the driver communicates with the FPGA-card in a separate "
+        "thread, so the HAL thread does not wait for the network. The status of the "
+        "FPGA is then always one period old. This setting only affects the driver."
+    )
+    io_worker_cpu: int = Field(
+        None,
+        help_text="The CPU to which the thread communicating with the FPGA-card is "
+        "pinned, preferably an isolated CPU. When not set, the thread is not pinned."
+    )
+    io_worker_priority: int = Field(
+        80,
+        help_text="The real-time priority (SCHED_FIFO) of the thread communicating "
+        "with the FPGA-card."
+    )
 
     @validator('mac_address', pre=True)
     def convert_mac_address(cls, value):
         return int(value, base=16)
+
+    @root_validator(skip_on_failure=True)
+    def check_interface(cls, values):
+        if values.get('transport') in ('raw', 'xdp') and not values.get('interface'):
+            raise ValueError(f"The interface is required when the transport is '{values.get('transport')}'.")
+        return values
+
+
+class EtherboneRecordReceiver(Module):
+    """
+    Record receiver for the Etherbone core of LiteEth, extended with burst reads.
+
+    A standard Etherbone record contains an address for each word to read, which makes
+    the request as large as the response. When the ``rff`` flag of the record is set,
+    the read part of the record only contains the return address and the address of the
+    first word, after which ``rcount`` consecutive words are read. The request for data
+    then has a fixed size, independent of the size of the MMIO. Records without the
+    ``rff`` flag are handled as by the receiver of LiteEth.
+    """
+    def __init__(self, buffer_depth=4):
+        self.sink   = sink   = stream.Endpoint(eth_etherbone_record_description(32))
+        self.source = source = stream.Endpoint(eth_etherbone_mmap_description(32))
+
+        # # #
+
+        fifo = stream.SyncFIFO(eth_etherbone_record_description(32), buffer_depth, buffered=True)
+        self.submodules += fifo
+        self.comb += sink.connect(fifo.sink)
+
+        base_addr = Signal(32, reset_less=True)
+        base_addr_update = Signal()
+        self.sync += If(base_addr_update, base_addr.eq(fifo.source.data))
+
+        count = Signal(max=512, reset_less=True)
+
+        # Registers for the burst, the record is no longer available in the FIFO when the
+        # words are read
+        burst_addr  = Signal(30, reset_less=True)
+        burst_count = Signal(8, reset_less=True)
+        burst_be    = Signal(4, reset_less=True)
+
+        self.submodules.fsm = fsm = FSM(reset_state="IDLE")
+        fsm.act("IDLE",
+            fifo.source.ready.eq(1),
+            NextValue(count, 0),
+            If(fifo.source.valid,
+                base_addr_update.eq(1),
+                If(fifo.source.wcount,
+                    NextState("RECEIVE_WRITES")
+                ).Elif(fifo.source.rcount & fifo.source.rff,
+                    NextState("RECEIVE_BURST_ADDR")
+                ).Elif(fifo.source.rcount,
+                    NextState("RECEIVE_READS")
+                )
+            )
+        )
+        fsm.act("RECEIVE_WRITES",
+            source.valid.eq(fifo.source.valid),
+            source.last.eq(count == fifo.source.wcount - 1),
+            source.count.eq(fifo.source.wcount),
+            source.be.eq(fifo.source.byte_enable),
+            source.addr.eq(base_addr[2:] + count),
+            source.we.eq(1),
+            source.data.eq(fifo.source.data),
+            fifo.source.ready.eq(source.ready),
+            If(source.valid & source.ready,
+                NextValue(count, count + 1),
+                If(source.last,
+                    If(fifo.source.rcount,
+                        NextState("RECEIVE_BASE_RET_ADDR")
+                    ).Else(
+                        NextState("IDLE")
+                    )
+                )
+            )
+        )
+        fsm.act("RECEIVE_BASE_RET_ADDR",
+            fifo.source.ready.eq(1),
+            NextValue(count, 0),
+            If(fifo.source.valid,
+                base_addr_update.eq(1),
+                If(fifo.source.rff,
+                    NextState("RECEIVE_BURST_ADDR")
+                ).Else(
+                    NextState("RECEIVE_READS")
+                )
+            )
+        )
+        fsm.act("RECEIVE_READS",
+            source.valid.eq(fifo.source.valid),
+            source.last.eq(count == fifo.source.rcount - 1),
+            source.count.eq(fifo.source.rcount),
+            source.be.eq(fifo.source.byte_enable),
+            source.base_addr.eq(base_addr),
+            source.addr.eq(fifo.source.data[2:]),
+            fifo.source.ready.eq(source.ready),
+            If(source.valid & source.ready,
+                NextValue(count, count + 1),
+                If(source.last,
+                    NextState("IDLE")
+                )
+            )
+        )
+        fsm.act("RECEIVE_BURST_ADDR",
+            fifo.source.ready.eq(1),
+            NextValue(count, 0),
+            If(fifo.source.valid,
+                NextValue(burst_addr, fifo.source.data[2:]),
+                NextValue(burst_count, fifo.source.rcount),
+                NextValue(burst_be, fifo.source.byte_enable),
+                NextState("BURST_READS")
+            )
+        )
+        fsm.act("BURST_READS",
+            source.valid.eq(1),
+            source.last.eq(count == burst_count - 1),
+            source.count.eq(burst_count),
+            source.be.eq(burst_be),
+            source.base_addr.eq(base_addr),
+            source.addr.eq(burst_addr + count),
+            If(source.ready,
+                NextValue(count, count + 1),
+                If(source.last,
+                    NextState("IDLE")
+                )
+            )
+        )
+
+
+def add_etherbone(soc, **kwargs):
+    """
+    Adds the Etherbone core to the SoC, using the record receiver with support for burst
+    reads (see ``EtherboneRecordReceiver``). The arguments are passed to ``add_etherbone``
+    of the SoC.
+    """
+    from liteeth.frontend import etherbone
+    receiver = etherbone.LiteEthEtherboneRecordReceiver
+    etherbone.LiteEthEtherboneRecordReceiver = EtherboneRecordReceiver
+    try:
+        soc.add_etherbone(**kwargs)
+    finally:
+        etherbone.LiteEthEtherboneRecordReceiver = receiver
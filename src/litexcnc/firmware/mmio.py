@@ -1,10 +1,13 @@
+import binascii
+import math
+import struct
 from random import setstate
 from typing import List
 from packaging.version import Version
 
 # Import from litex
 from migen.fhdl.module import Module
-from litex.soc.interconnect.csr import AutoCSR, CSRStatus, CSRStorage, CSRConstant
+from litex.soc.interconnect.csr import AutoCSR, CSRStatus, CSRStorage, CSRConstant, _CSRBase
 from migen import *
 
 # Local imports
@@ -32,19 +35,29 @@ class MMIO(Module, AutoCSR):
         this class. This can be inspected by reviewing the generated csr.csv. The driver
         expects the information blocks in the following order:
         - WRITE:
-          - Watchdog;
           - GPIO;
           - PWM;
+          - Encoder;
+          - Watchdog;
           - StepGen;
+          - Sequence number;
         - READ:
           - Watchdog;
           - Wall clock;
-          - GPIO;
           - StepGen;
+          - Encoder;
+          - GPIO;
+
+        The registers of the modules which can be exchanged at a low rate (GPIO, PWM) are
+        located at the start of the output and the end of the input, so the driver can
+        exchange the other registers at a high rate without them (see the functions
+        `read-fast` and `write-fast` of the driver).
 
         When the order of the MMIO is mis-aligned with respect to the driver this might
         lead to errors (writing to the wrong registers) or the FPGA being hung up (when
-        writing to a read-only register).
+        writing to a read-only register). Therefore the size of each section of the
+        registers is recorded and a hash of these sizes is stored in the register `layout`,
+        which is compared by the driver with the hash of its own layout.
         """
         # INITIALISATION
         self.magic = CSRStatus(
@@ -69,6 +82,12 @@ class MMIO(Module, AutoCSR):
             description="The CRC of the configuration file used to create this firmware. Used to "
             "ensure the driver uses the same configuration file for initiating the communication."
         )
+        self.layout = CSRStatus(
+            size=32,
+            description="Hash of the layout of the registers: the CRC of the sizes of the sections of the "
+            "configuration, output and input registers (see `layout_hash`). The driver calculates the same "
+            "hash from its definition of the data and refuses the FPGA when these differ."
+        )
         self.reset = CSRStorage(
             size=1, 
             description="Reset.\nWhile True (set to 1) the card is being forced in reset-mode. In "
@@ -77,6 +96,8 @@ class MMIO(Module, AutoCSR):
             "of the steppers.", 
             name='reset'
         )
+        self._layout_sections = []
+        self._layout_mark = len(self._csrs())
 
         # INIT - for stepgen
         self.loop_cycles = CSRStatus(
@@ -86,10 +107,22 @@ class MMIO(Module, AutoCSR):
             "close. This parameter is used by the stepgen module to start the (expected) motion for the next "
             "segement."
         )
+        self._add_layout_section('config', 'general')
         StepgenModule.add_mmio_config_registers(self, config.stepgen)
+        self._add_layout_section('config', 'stepgen')
 
 
         # OUTPUT (as seen from the PC!)
+        # The registers which change only occasionally come first, the registers which
+        # change each cycle last. The driver only sends the data starting from the first
+        # register which has changed, so the static part is skipped most of the time.
+        # - Modules (changing occasionally)
+        GPIO_Out.add_mmio_write_registers(self, config.gpio_out)
+        self._add_layout_section('write', 'gpio')
+        PwmPdmModule.add_mmio_write_registers(self, config.pwm)
+        self._add_layout_section('write', 'pwm')
+        EncoderModule.add_mmio_write_registers(self, config.encoders)
+        self._add_layout_section('write', 'encoder')
         # - Watchdog
         self.watchdog_data = CSRStorage(
             size=32, 
@@ -98,11 +131,20 @@ class MMIO(Module, AutoCSR):
             name='watchdog_data',
             write_from_dev=True
         )
-        # - Modules
-        GPIO_Out.add_mmio_write_registers(self, config.gpio_out)
-        PwmPdmModule.add_mmio_write_registers(self, config.pwm)
+        self._add_layout_section('write', 'watchdog')
+        # - Modules (changing each cycle)
         StepgenModule.add_mmio_write_registers(self, config.stepgen)
-        EncoderModule.add_mmio_write_registers(self, config.encoders)
+        self._add_layout_section('write', 'stepgen')
+        # - Sequence number. This register is placed between the output and the input, so
+        #   the driver can read it together with the input in a single burst.
+        self.sequence = CSRStorage(
+            size=32,
+            description="Sequence number.\nWritten by the driver in the same record as the request for "
+            "data and read back as the first word of the response. The driver uses the echoed number "
+            "to recognize and drop late responses to earlier requests.",
+            name='sequence'
+        )
+        self._add_layout_section('footer', 'sequence')
 
         # INPUT (as seen from the PC!)
         # - Watchdog
@@ -111,17 +153,103 @@ class MMIO(Module, AutoCSR):
             description="Watchdog has bitten.\nFlag which is set when timeout has occurred.", 
             name='watchdog_has_bitten'
         )
+        self._add_layout_section('read', 'watchdog')
         # - Wall-clock
         self.wall_clock = CSRStatus(
-            size=64, 
+            size=32 if config.compact_status else 64, 
             description="Wall-clock.\n Counter which contains the amount of clock cycles which have "
             "been passed since the start of the device. The width of the counter is 64-bits, which "
             "means that a roll-over will practically never occur during the runtime of a "
-            "machine (order of magnitude centuries at 1 GHz).",  
+            "machine (order of magnitude centuries at 1 GHz). With the compact status the width is "
+            "32 bits, the driver keeps track of the roll-overs.",  
             name='wall_clock'
         )
-        # Modules
-        GPIO_In.add_mmio_read_registers(self, config.gpio_in)
-        StepgenModule.add_mmio_read_registers(self, config.stepgen)
-        EncoderModule.add_mmio_read_registers(self, config.encoders)
+        self._add_layout_section('read', 'wallclock')
+        # Modules (read each cycle)
+        StepgenModule.add_mmio_read_registers(self, config.stepgen, compact_status=config.compact_status)
+        self._add_layout_section('read', 'stepgen')
         EncoderModule.add_mmio_read_registers(self, config.encoders)
+        self._add_layout_section('read', 'encoder')
+        # Modules (can be read at a low rate)
+        GPIO_In.add_mmio_read_registers(self, config.gpio_in)
+        self._add_layout_section('read', 'gpio')
+
+        # Store the hash of the layout, now all registers are known
+        self.layout.status.reset = Constant(self.layout_hash, 32)
+
+    def _csrs(self):
+        """
+        Returns the registers of the MMIO (name of the attribute and register) in the order
+        in which they have been created, which is the order of the registers in the memory.
+        """
+        return [(name, csr) for name, csr in self.__dict__.items() if isinstance(csr, _CSRBase)]
+
+    def _add_layout_section(self, block, name):
+        """
+        Records the registers created since the previous section as a section of the
+        given block (`config`, `write`, `read` or `footer`). Each register takes a
+        whole number of 32-bit words.
+        """
+        csrs = self._csrs()[self._layout_mark:]
+        self._layout_mark += len(csrs)
+        registers = [(name, 4 * int(math.ceil(csr.size / 32))) for name, csr in csrs]
+        self._layout_sections.append((block, name, registers))
+
+    @property
+    def layout_hash(self):
+        """
+        The CRC of the sizes (in bytes, as big-endian 32-bit integers) of the sections of
+        the configuration, output and input registers, in the order of the memory. The
+        sequence number (footer) is used by the Etherbone driver only and not included.
+        """
+        sizes = [
+            sum(size for _, size in registers) 
+            for block, _, registers in self._layout_sections 
+            if block in ('config', 'write', 'read')
+        ]
+        return binascii.crc32(struct.pack(f'>{len(sizes)}I', *sizes))
+
+    def layout_header(self, board_name):
+        """
+        Returns a C-header describing the layout of the registers of this board: the hash
+        of the layout, the offset and size of each section and register (relative to the
+        start of its block) and a packed struct for each block. All data is big-endian.
+        The header can be used to inspect the data exchanged with the board, or as basis
+        for a driver specialised for this board.
+        """
+        guard = '__INCLUDE_LITEXCNC_LAYOUT_H__'
+        lines = [
+            f'// Layout of the registers of the LitexCNC firmware for board `{board_name}`.',
+            '// This file is generated by `litexcnc build_firmware`, do not edit.',
+            f'#ifndef {guard}',
+            f'#define {guard}',
+            '',
+            '#include <stdint.h>',
+            '',
+            f'#define LITEXCNC_LAYOUT_HASH 0x{self.layout_hash:08X}',
+        ]
+        for block in ('config', 'write', 'footer', 'read'):
+            sections = [(name, registers) for section_block, name, registers in self._layout_sections if section_block == block]
+            prefix = f'LITEXCNC_LAYOUT_{block.upper()}'
+            fields = []
+            offset = 0
+            lines.append('')
+            lines.append(f'// {block}')
+            for name, registers in sections:
+                size = sum(size for _, size in registers)
+                lines.append(f'#define {prefix}_{name.upper()}_OFFSET {offset}')
+                lines.append(f'#define {prefix}_{name.upper()}_SIZE {size}')
+                for register, register_size in registers:
+                    lines.append(f'#define {prefix}_REG_{register.upper()}_OFFSET {offset}')
+                    fields.append(f'    uint32_t {register}[{register_size // 4}];')
+                    offset += register_size
+            lines.append(f'#define {prefix}_SIZE {offset}')
+            if fields:
+                lines.append('#pragma pack(push,4)')
+                lines.append('typedef struct {')
+                lines.extend(fields)
+                lines.append(f'}} litexcnc_layout_{block}_t;')
+                lines.append('#pragma pack(pop)')
+        lines.append('')
+        lines.append('#endif')
+        return '\n'.join(lines) + '\n'
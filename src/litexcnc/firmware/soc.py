@@ -27,6 +27,12 @@ class LitexCNC_Firmware(BaseModel):
     clock_frequency: int = Field(
       50e6  
     )
+    compact_status: bool = Field(
+        False,
+        description="Send the status of the FPGA in the compact format: the wall clock and the "
+        "positions of the stepgens are 32 bits wide instead of 64 bits. The driver reconstructs the "
+        "full values from the previous values."
+    )
     ethphy: EthPhy = Field(
         ...
     )
@@ -112,7 +118,7 @@ class LitexCNC_Firmware(BaseModel):
                 GPIO_In.create_from_config(self, config.gpio_in)
                 GPIO_Out.create_from_config(self, config.gpio_out)
                 PwmPdmModule.create_from_config(self, watchdog,config.pwm)
-                StepgenModule.create_from_config(self, watchdog, config.stepgen)
+                StepgenModule.create_from_config(self, watchdog, config.stepgen, compact_status=config.compact_status)
                 EncoderModule.create_from_config(self, config.encoders)
                 
         return _LitexCNC_SoC(
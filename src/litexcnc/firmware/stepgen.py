@@ -47,6 +47,16 @@ class StepGenPinoutStepDirBaseConfig(BaseModel):
         ]
         generator.hold_dds = Signal()
 
+        # The actions when a step is made: reset the counters for the timings. In toggle
+        # mode the step pin is toggled as well, each edge of the pin is a step.
+        step_actions = [
+            generator.steplen_counter.counter.eq(generator.steplen),
+            generator.dir_hold_counter.counter.eq(generator.steplen + generator.dir_hold_time),
+            generator.dir_setup_counter.counter.eq(generator.steplen + generator.dir_hold_time + generator.dir_setup_time),
+        ]
+        if generator.toggle_step:
+            step_actions.append(generator.step.eq(~generator.step))
+
         # Translate the position to steps by looking at the n'th bit (pick-off)
         # NOTE: to be able to simply add the velocity to the position for every timestep, the position
         # registered is widened from the default 64-buit width to 64-bit + difference in pick-off for
@@ -63,9 +73,7 @@ class StepGenPinoutStepDirBaseConfig(BaseModel):
                 # The relevant bit has toggled, make a step to the next position by
                 # resetting the counters
                 generator.step_prev.eq(generator.position[generator.pick_off_vel]),
-                generator.steplen_counter.counter.eq(generator.steplen),
-                generator.dir_hold_counter.counter.eq(generator.steplen + generator.dir_hold_time),
-                generator.dir_setup_counter.counter.eq(generator.steplen + generator.dir_hold_time + generator.dir_setup_time),
+                *step_actions,
                 generator.wait.eq(False)
             ).Else(
                 generator.wait.eq(True)
@@ -78,13 +86,14 @@ class StepGenPinoutStepDirBaseConfig(BaseModel):
         )
 
         # Convert the parameters to output of step and dir
-        # - step
-        generator.sync += If(
-            generator.steplen_counter.counter > 0,
-            generator.step.eq(1)
-        ).Else(
-            generator.step.eq(0)
-        )
+        # - step (in toggle mode the pin is toggled when the step is made)
+        if not generator.toggle_step:
+            generator.sync += If(
+                generator.steplen_counter.counter > 0,
+                generator.step.eq(1)
+            ).Else(
+                generator.step.eq(0)
+            )
         # - dir
         generator.sync += If(
             generator.dir != (generator.speed[32 + (generator.pick_off_acc - generator.pick_off_vel) - 1]),
@@ -216,6 +225,33 @@ class StepgenConfig(BaseModel):
         "disabled. When True, the stepgen will stop the machine with respect to the "
         "acceleration limits and then be disabled. Default value: False."
     )
+    max_frequency: float = Field(
+        400e3,
+        gt=0,
+        description="The maximum step frequency of the driver of this channel (in Hz). "
+        "The resolution of the speed is chosen such that the stepgen can reach this "
+        "frequency, a lower frequency gives a finer resolution. Default value: 400 kHz."
+    )
+    step_mode: Literal['pulse', 'toggle'] = Field(
+        'pulse',
+        description="The output of the step pin. With 'pulse' each step is a pulse of length "
+        "`steplen`. With 'toggle' the step pin is toggled for each step, for drivers which "
+        "step on both edges. In this mode the maximum step rate is twice `max_frequency`, "
+        "as each period of the signal on the pin contains two steps. Default value: 'pulse'."
+    )
+
+    def pick_off(self, clock_frequency):
+        """
+        Returns the pick-offs for position, speed and acceleration of this channel. The
+        shift of the speed is the smallest shift for which the maximum step rate (a speed
+        of 2^31, which is clock_frequency / 2^(shift + 1)) does not exceed `max_frequency`,
+        or twice `max_frequency` in toggle mode. The driver uses the same formula.
+        """
+        max_step_rate = self.max_frequency * (2 if self.step_mode == 'toggle' else 1)
+        shift = 0
+        while (clock_frequency / (1 << (shift + 1)) > max_step_rate):
+            shift += 1
+        return (32, 32 + shift, 32 + shift + 8)
 
 
 class StepgenCounter(Module, AutoDoc):
@@ -238,12 +274,14 @@ class StepgenCounter(Module, AutoDoc):
 
 class StepgenModule(Module, AutoDoc):
 
-    def __init__(self, pads, pick_off, soft_stop, create_routine) -> None:
+    def __init__(self, pads, pick_off, soft_stop, create_routine, toggle_step=False) -> None:
         """
         
         NOTE: pickoff should be a three-tuple. A different pick-off for position, speed
         and acceleration is supported. When pick-off is a integer, all the pick offs will
         be the same.
+        When toggle_step is True, the step pin is toggled for each step instead of
+        generating a pulse.
         """
 
         self.intro = ModuleDoc("""
@@ -296,6 +334,9 @@ class StepgenModule(Module, AutoDoc):
         # - speed_reset_val: 0x8000_0000 in case of 32-bit variable, otherwise increase to set the sign bit
         self.speed_reset_val = (0x8000_0000 << (self.pick_off_acc - self.pick_off_vel)) 
 
+        # Output mode of the step pin (used by the routine)
+        self.toggle_step = toggle_step
+
         # Values which determine the spacing of the step. These
         # are used to reset the counters.
         # - signals
@@ -397,27 +438,37 @@ class StepgenModule(Module, AutoDoc):
     def add_mmio_config_registers(cls, mmio, config: List[StepgenConfig]):
         """
         Adds the configuration registers to the MMIO. The configuration registers
-        contain information on the the timings of ALL stepgen.
-        TODO: in the next iteration of the stepgen timing configs should be for each
-        stepgen individually.
+        contain the timings of each stepgen.
         """
-        mmio.stepgen_stepdata = CSRStorage(
-            fields=[
-                CSRField("steplen", size=10, offset=0, description="The length of the step pulse in clock cycles"),
-                CSRField("dir_hold_time", size=10, offset=10, description="The minimum delay (in clock cycles) after a step pulse before "),
-                CSRField("dir_setup_time", size=12, offset=20, description="The minimum delay (in clock cycles) after a direction change and before the next step - may be longer"),
-            ],
-            name=f'stepgen_stepdata',
-            description=f'The length of the step pulse in clock cycles',
-            write_from_dev=False
-        )
+        # Don't create the registers when the config is empty (no stepgens
+        # defined in this case)
+        if not config:
+            return
+
+        for index, _ in enumerate(config):
+            setattr(
+                mmio,
+                f'stepgen_{index}_stepdata',
+                CSRStorage(
+                    fields=[
+                        CSRField("steplen", size=10, offset=0, description="The length of the step pulse in clock cycles"),
+                        CSRField("dir_hold_time", size=10, offset=10, description="The minimum delay (in clock cycles) after a step pulse before "),
+                        CSRField("dir_setup_time", size=12, offset=20, description="The minimum delay (in clock cycles) after a direction change and before the next step - may be longer"),
+                    ],
+                    name=f'stepgen_{index}_stepdata',
+                    description=f'The timings of the step pulses for stepper {index}.',
+                    write_from_dev=False
+                )
+            )
     
     @classmethod
-    def add_mmio_read_registers(cls, mmio, config: List[StepgenConfig]):
+    def add_mmio_read_registers(cls, mmio, config: List[StepgenConfig], compact_status=False):
         """
         Adds the status registers to the MMIO.
         NOTE: Status registers are meant to be read by LinuxCNC and contain
-        the current status of the stepgen.
+        the current status of the stepgen. With the compact status only the bits
+        16 - 47 of the position are reported, the driver reconstructs the full
+        position.
         """
         # Don't create the registers when the config is empty (no stepgens
         # defined in this case)
@@ -429,7 +480,7 @@ class StepgenModule(Module, AutoDoc):
                 mmio,
                 f'stepgen_{index}_position',
                 CSRStatus(
-                    size=64,
+                    size=32 if compact_status else 64,
                     name=f'stepgen_{index}_position',
                     description=f'stepgen_{index}_position',
                 )
@@ -494,7 +545,7 @@ class StepgenModule(Module, AutoDoc):
 
 
     @classmethod
-    def create_from_config(cls, soc: SoC, watchdog, config: List[StepgenConfig]):
+    def create_from_config(cls, soc: SoC, watchdog, config: List[StepgenConfig], compact_status=False):
         """
         Adds the module as defined in the configuration to the SoC.
         NOTE: the configuration must be a list and should contain all the module at
@@ -505,12 +556,6 @@ class StepgenModule(Module, AutoDoc):
         if not config:
             return
 
-        # Determine the pick-off for the velocity. This one is based on the clock-frequency
-        # and the step frequency to be obtained
-        shift = 0
-        while (soc.clock_frequency / (1 << shift) > 400e3):
-            shift += 1
-
         for index, stepgen_config in enumerate(config):
             soc.platform.add_extension([
                 ("stepgen", index,
@@ -520,9 +565,10 @@ class StepgenModule(Module, AutoDoc):
             # Create the stepgen and add to the system
             stepgen = cls(
                 pads=soc.platform.request('stepgen', index),
-                pick_off=(32, 32 + shift, 32 + shift + 8),
+                pick_off=stepgen_config.pick_off(soc.clock_frequency),
                 soft_stop=stepgen_config.soft_stop,
-                create_routine=stepgen_config.pins.create_routine
+                create_routine=stepgen_config.pins.create_routine,
+                toggle_step=(stepgen_config.step_mode == 'toggle')
             )
             soc.submodules += stepgen
             # Connect all the memory
@@ -530,19 +576,28 @@ class StepgenModule(Module, AutoDoc):
                 # Data from MMIO to stepgen
                 stepgen.reset.eq(soc.MMIO_inst.reset.storage),
                 stepgen.enable.eq(~watchdog.has_bitten),
-                stepgen.steplen.eq(soc.MMIO_inst.stepgen_stepdata.fields.steplen),
-                stepgen.dir_hold_time.eq(soc.MMIO_inst.stepgen_stepdata.fields.dir_hold_time),
-                stepgen.dir_setup_time.eq(soc.MMIO_inst.stepgen_stepdata.fields.dir_setup_time),
+                stepgen.steplen.eq(getattr(soc.MMIO_inst, f'stepgen_{index}_stepdata').fields.steplen),
+                stepgen.dir_hold_time.eq(getattr(soc.MMIO_inst, f'stepgen_{index}_stepdata').fields.dir_hold_time),
+                stepgen.dir_setup_time.eq(getattr(soc.MMIO_inst, f'stepgen_{index}_stepdata').fields.dir_setup_time),
             ]
             soc.sync += [
                 # Position and feedback from stepgen to MMIO
-                getattr(soc.MMIO_inst, f'stepgen_{index}_position').status.eq(stepgen.position[(stepgen.pick_off_vel - stepgen.pick_off_pos):]),
+                getattr(soc.MMIO_inst, f'stepgen_{index}_position').status.eq(stepgen.position[(stepgen.pick_off_vel - stepgen.pick_off_pos) + (16 if compact_status else 0):]),
                 getattr(soc.MMIO_inst, f'stepgen_{index}_speed').status.eq(stepgen.speed[(stepgen.pick_off_acc - stepgen.pick_off_vel):])
             ]
-            # Add speed target and the max acceleration in the protected sync
+            # Add speed target and the max acceleration in the protected sync. With the
+            # compact status the wall clock is 32 bits wide and rolls over, the apply time
+            # is then compared with the lower 32 bits of the apply time (time has passed
+            # when the difference is positive).
+            if compact_status:
+                apply_delta = Signal(32)
+                soc.comb += apply_delta.eq(soc.MMIO_inst.wall_clock.status - soc.MMIO_inst.stepgen_apply_time.storage[:32])
+                apply = ~apply_delta[31]
+            else:
+                apply = soc.MMIO_inst.wall_clock.status >= soc.MMIO_inst.stepgen_apply_time.storage
             soc.sync += [
                 If(
-                    soc.MMIO_inst.wall_clock.status >= soc.MMIO_inst.stepgen_apply_time.storage,
+                    apply,
                     stepgen.speed_target.eq(Cat(Constant(0, bits_sign=(stepgen.pick_off_acc - stepgen.pick_off_vel)), getattr(soc.MMIO_inst, f'stepgen_{index}_speed_target').storage)),
                     stepgen.max_acceleration.eq(getattr(soc.MMIO_inst, f'stepgen_{index}_max_acceleration').storage),
                 )
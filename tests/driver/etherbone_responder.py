@@ -0,0 +1,129 @@
+"""
+Minimal Etherbone responder, which emulates the memory of a FPGA-card running the
+LitexCNC firmware. This can be used to test the transports of the driver without a
+FPGA-card, for example over a veth pair:
+
+    sudo ip netns add board
+    sudo ip link add veth-host type veth peer name veth-board
+    sudo ip link set veth-board netns board
+    sudo ip addr add 192.168.0.1/24 dev veth-host
+    sudo ip link set veth-host up
+    sudo ip netns exec board ip link set veth-board address 10:e2:d5:00:00:00
+    sudo ip netns exec board ip addr add 192.168.0.50/24 dev veth-board
+    sudo ip netns exec board ip link set veth-board up
+    sudo ip netns exec board python3 etherbone_responder.py /workspace/examples/5a-75e.json
+
+The registers are plain memory: all data written is read back as is. The magic,
+version, fingerprint and layout are set, so the driver accepts the responder as a board.
+"""
+import argparse
+import binascii
+import json
+import math
+import socket
+import struct
+
+import litexcnc.firmware
+
+
+def version_register(version):
+    major, minor, patch = (int(part) for part in version.split('.'))
+    return (major << 16) + (minor << 8) + patch
+
+
+def layout_register(config):
+    """
+    Calculates the hash of the layout of the registers, as the firmware would (see
+    `MMIO.layout_hash`), from the sizes of the sections in bytes.
+    """
+    def flags(items):
+        return 4 * int(math.ceil(len(items) / 32))
+    gpio_in = config.get('gpio_in', [])
+    gpio_out = config.get('gpio_out', [])
+    pwm = config.get('pwm', [])
+    stepgen = config.get('stepgen', [])
+    encoders = config.get('encoders', [])
+    compact = config.get('compact_status', False)
+    sizes = [
+        # Configuration (general, stepgen timings per channel)
+        4, 4 * len(stepgen),
+        # Write
+        flags(gpio_out),
+        flags(pwm) + 8 * len(pwm),
+        2 * flags(encoders),
+        4,
+        (8 if stepgen else 0) + 8 * len(stepgen),
+        # Read
+        4,
+        4 if compact else 8,
+        (8 if compact else 12) * len(stepgen),
+        flags(encoders) + 4 * len(encoders),
+        flags(gpio_in),
+    ]
+    return binascii.crc32(struct.pack(f'>{len(sizes)}I', *sizes))
+
+
+class Responder:
+
+    def __init__(self, config_file, port=1234):
+        with open(config_file, 'rb') as config:
+            contents = config.read()
+        fingerprint = binascii.crc32(contents)
+        self.port = port
+        self.memory = {
+            0x0: 0x18052022,
+            0x4: version_register(litexcnc.firmware.__version__),
+            0x8: fingerprint,
+            0xC: layout_register(json.loads(contents)),
+        }
+
+    def handle(self, packet):
+        """
+        Processes a single Etherbone packet and returns the response (or None when
+        no data is requested).
+        """
+        if len(packet) < 12 or packet[0:2] != b'\x4e\x6f':
+            return None
+        flags, _, wcount, rcount = struct.unpack_from('>BBBB', packet, 8)
+        words = struct.unpack_from(f'>{(len(packet) - 12) // 4}I', packet, 12)
+        index = 0
+        # Writes: base address followed by the data (auto-increment)
+        if wcount:
+            base = words[index]
+            for i in range(wcount):
+                self.memory[base + 4 * i] = words[index + 1 + i]
+            index += 1 + wcount
+        # Reads: return address followed by the addresses to read, or only the first
+        # address for a burst read (rff flag, LitexCNC extension)
+        if not rcount:
+            return None
+        base_ret = words[index]
+        if flags & 0x04:
+            addresses = [words[index + 1] + 4 * i for i in range(rcount)]
+        else:
+            addresses = words[index + 1:index + 1 + rcount]
+        data = [self.memory.get(address, 0) for address in addresses]
+        return (
+            packet[0:8]
+            + struct.pack('>BBBBI', 0x00, 0x0f, len(data), 0, base_ret)
+            + struct.pack(f'>{len(data)}I', *data)
+        )
+
+    def serve(self, address='0.0.0.0'):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.bind((address, self.port))
+        while True:
+            packet, (host, _) = sock.recvfrom(2048)
+            response = self.handle(packet)
+            if response is not None:
+                # LiteEth responds to the same port as it listens to
+                sock.sendto(response, (host, self.port))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('config', help="The json-file used for the driver.")
+    parser.add_argument('--address', default='0.0.0.0', help="The address to listen on.")
+    parser.add_argument('--port', type=int, default=1234, help="The port to listen on.")
+    args = parser.parse_args()
+    Responder(args.config, args.port).serve(args.address)